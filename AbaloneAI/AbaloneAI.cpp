@@ -7,6 +7,8 @@
 #include <string>
 #include <sstream>
 #include <unordered_map>
+#include <queue>
+#include <functional>
 
 #include <numeric>
 #include <ranges>
@@ -14,11 +16,37 @@
 #include <algorithm>
 
 #include <iostream>
+#include <iomanip>
+#include <fstream>
 #include <cstdlib>
+#include <cstdint>
 #include <climits>
 
+#include <cmath>
+
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <new>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// the distributed analysis talks over sockets, only where they are posix
+#if defined(__unix__) || defined(__APPLE__)
+#define ABALONE_SOCKETS
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
 
 
 
@@ -31,7 +59,9 @@ using namespace std;
 
 #define in :
 #define is ==
-#define not !
+#if defined(_MSC_VER) && !defined(__clang__)
+#define not !   // gcc and clang already treat not as the ! operator and refuse to redefine it
+#endif
 
 #define var auto
 #define let const auto
@@ -73,46 +103,52 @@ enum dir {
 let dirs = array<dir, 6> { UP, FORWARD, RIGHT, DOWN, BACK, LEFT };
 let half_dirs = array<dir, 3> { UP, FORWARD, RIGHT };
 
-let DIRS = array<point, 6> { point{ 0,  1 }, point{ 1,  1 }, point{ 1,  0 }, point{ 0, -1 }, point{ -1, -1 }, point{ -1,  0 } };
-
+constexpr let DIRS = array<point, 6> { point{ 0,  1 }, point{ 1,  1 }, point{ 1,  0 }, point{ 0, -1 }, point{ -1, -1 }, point{ -1,  0 } };
 
 
-template<typename type, int size_x, int size_y>
-struct array2d {
-	array<array<type, size_y>, size_x> inner;
 
-	func& operator[](int);
-	func& operator[](point);
-};
-
-enum color {
+enum color : int8_t {
 	WHITE = -1,
 	EMPTY = 0,
 	BLACK = 1,
+	OUTSIDE = 2,   // only the OFF_BOARD cell, it is neither a piece nor empty
 };
 
 
 struct piecedata {
 	color           piececolor;
-	array<char, 6>  neighbors;
-	array<bool, 6>  dirtyflags;
 };
 
 
-struct movedata {
-	// data needed for a move
-	color piececolor;
-	point origin;
-	dir direction;
-	int pulled_neighbors;
-	dir pulled_direction;
+// cells are numbered x * 9 + y. rays that leave the board end on OFF_BOARD, one
+// extra cell behind the others, so walking a ray never needs a bounds check
+let CELLS = 81;
+let OFF_BOARD = 81;
+
+// the 9x9 grid in one flat array with the OFF_BOARD cell at the end
+struct cellarray {
+	array<piecedata, CELLS + 1> cells;
 
-	// move score, needed for move ordering
-	float score = 0;
+	init cellarray();
 
-	// data needed for undoing 
-	int pushed_enemies = 0;
-	bool captured_enemy = false;
+	func operator[](int x) -> piecedata*;                 // the column, pieces[x][y]
+	func operator[](point) -> piecedata&;
+	func cell(int index) -> piecedata&;
+	func cell(int index) const -> const piecedata&;
+};
+
+
+struct movedata {
+	// packed into 20 bits, lowest first:
+	//  7 origin index (x * 9 + y)
+	//  3 direction
+	//  2 pulled neighbors
+	//  3 pulled direction
+	//  the 15 bits above identify the move, the rest is data needed for undoing
+	//  2 pushed enemies
+	//  1 captured enemy
+	//  2 color (two's complement, EMPTY for the none move)
+	uint32_t bits = 0;
 
 
 
@@ -120,50 +156,290 @@ struct movedata {
 	init movedata(color, point, dir, int);        // for strait, non pushing moves
 	init movedata(color, point, dir, int, bool, int);  // for strait, pushing moves
 	init movedata(color, point, dir, int, dir);   // for broadside moves
+	init movedata(color, point, dir, int, dir, int, bool);  // every field, for undoing
 
-	func evaluate() -> int;
-	func is_valid() -> bool;
+	func piececolor() const -> color;
+	func origin() const -> point;
+	func direction() const -> dir;
+	func pulled_neighbors() const -> int;
+	func pulled_direction() const -> dir;
+	func pushed_enemies() const -> int;
+	func captured_enemy() const -> bool;
+	func id() const -> uint16_t;
+
+	func evaluate() const -> int;
+	func is_valid() const -> bool;
+
+	func repr() const -> string;
+};
+
+
+// every piece has 6 directions with at most 3 strait, 4 broadside or 2 pushing moves each
+let MAX_MOVES = 14 * 6 * 7;
+let MAX_PLY = 64;
+let MAX_SEARCHED_MOVES = 20;   // the search only looks at the best moves by ordering
+
+// fixed capacity move list, so generating moves never touches the heap.
+// the ordering scores live in their own array next to the moves
+struct movelist {
+	array<movedata, MAX_MOVES> moves;
+	array<int16_t, MAX_MOVES> scores;
+	int count = 0;
+
+	func push_back(movedata move) { scores[count] = int16_t(move.evaluate()); moves[count++] = move; }
+	func& operator[](int i) { return moves[i]; }
+	func move_to(int from, int to) {   // shifts the moves between one up, their order stays
+		rotate(moves.begin() + to, moves.begin() + from, moves.begin() + from + 1);
+		rotate(scores.begin() + to, scores.begin() + from, scores.begin() + from + 1);
+	}
+
+	func size() const { return count; }
+	func begin() { return moves.begin(); }
+	func end() { return moves.begin() + count; }
+};
+
+
+enum bound : uint8_t {
+	NO_BOUND = 0,    // empty entry
+	EXACT = 1,
+	LOWER = 2,       // failed high, the score is at least this
+	UPPER = 3,       // failed low, the score is at most this
+};
+
+struct ttentry {
+	int score = 0;
+	uint16_t move = 0;   // movedata::id() of the best move, 0 if there was none
+	int8_t depth = 0;
+	bound kind = NO_BOUND;
+};
+
+// an entry packed into one word, stored next to the key xor that word. a slot half
+// written by another thread does not match its key and reads as empty
+struct ttslot {
+	atomic<uint64_t> check = 0;
+	atomic<uint64_t> data = 0;
+};
+
+// fixed size, always replacing transposition table. it is allocated once and
+// shared between copies of a board, also across threads
+struct transtable {
+	vector<ttslot> slots;
+	uint64_t mask;
+
+	init transtable(int size_log2 = 20);
 
-	func repr()->string;
+	func probe(uint64_t key) -> ttentry;
+	func store(uint64_t key, int score, bound kind, int depth, movedata move) -> void;
+	func clear() -> void;
 };
 
 
+struct searchstats {
+	uint64_t nodes = 0;
+	uint64_t eval_probes = 0;
+	uint64_t eval_hits = 0;
+};
+
+
+// fixed size, always replacing cache of evaluations, shared and lock-free like the
+// transposition table. the slot holds the score and a bit that it is used
+struct evalcache {
+	vector<ttslot> slots;
+	uint64_t mask;
+
+	init evalcache(int size_log2 = 16);
+
+	func probe(uint64_t key, int& score) -> bool;
+	func store(uint64_t key, int score) -> void;
+};
+
+
+// what a search may spend. every engine takes these, so they can be compared at equal cost
+struct searchlimits {
+	int depth = MAX_PLY - 1;
+	chrono::milliseconds time = chrono::milliseconds(0);   // 0 is no time limit
+	int threads = 1;                                       // mcts and the parallel alpha beta
+	const atomic<bool>* stop = nullptr;                    // set from outside to abort
+	chrono::milliseconds clock = chrono::milliseconds(0);  // left for the game, alpha beta then ignores time, see TIME MANAGEMENT
+};
+
+// larger than any evaluation, including a won game
+let INFINITE_SCORE = 100000000;
+
+// a position that was already on the board is a draw
+let DRAW_SCORE = 0;
+let NO_REPETITION = INT_MAX;
+
+
+// one root move of a multi pv search. the score is exact for the best lines,
+// for the others it is only an upper bound
+struct rootline {
+	movedata move;
+	int score = -INFINITE_SCORE;
+	bool exact = false;
+	vector<movedata> pv;   // starts with move
+};
+
+
+// the neural network evaluation, see the NNUE section. one input per (color, cell),
+// the first layer is summed up per position and kept up to date move by move
+let NNUE_INPUTS = 2 * 81;
+let NNUE_HIDDEN = 32;
+let NNUE_L2 = 32;
+let NNUE_SHIFT = 6;   // the int8 weights are fixed point with 6 fraction bits
 
-struct board {
+struct accumulator {
+	alignas(32) array<int16_t, NNUE_HIDDEN> values;
+};
+
+struct nnue {
+	alignas(32) array<int16_t, NNUE_INPUTS * NNUE_HIDDEN> input_weights;
+	alignas(32) array<int16_t, NNUE_HIDDEN> input_bias;
+	alignas(32) array<int8_t, NNUE_L2 * NNUE_HIDDEN> hidden_weights;
+	array<int32_t, NNUE_L2> hidden_bias;
+	alignas(32) array<int8_t, NNUE_L2> output_weights;
+	int32_t output_bias;
+
+	func load(string path) -> bool;
+	func save(string path) const -> bool;
+
+	func refresh(accumulator&, const cellarray&) const -> void;
+	func add(accumulator&, point, color) const -> void;
+	func remove(accumulator&, point, color) const -> void;
+	func evaluate(const accumulator&) const -> int;
+};
+
+// the loaded network, nullptr without one. the accumulators are only kept up to date while it is set
+unique_ptr<nnue> network;
+
+enum evaluator {
+	HANDCRAFTED,
+	NETWORK,
+};
+
+
+// forward pruning, see PROBCUT. a search of shallow plies predicts the one of the full
+// depth as a * score + b, off by sigma on average. fitted by the calibrate tool
+struct probcutfit {
+	int shallow = 0;   // 0 is no fit, nodes of this depth are not pruned
+	double a = 1;
+	double b = 0;
+	double sigma = 0;
+};
+
+struct probcutmodel {
+	array<probcutfit, MAX_PLY> fits;   // by the depth left
+
+	func load(string path) -> bool;
+	func save(string path) const -> bool;
+};
 
-	array2d<piecedata, 9, 9> pieces;
+// the loaded fits, nullptr without them
+unique_ptr<probcutmodel> probcut_model;
+
+
+// everything that describes the position. plain data, so the copy-make search can
+// snapshot it with a single copy
+struct boardstate {
+	cellarray pieces;
 	color current_turn;
 
 	int captured_white_pieces = 0;
 	int captured_black_pieces = 0;
 
-	unordered_map<uint64_t, int> transposition_table;
-	uint64_t boardhash = 0;
+	uint64_t boardhash = 0;   // pieces, captures and side to move, see compute_hash
+
+	accumulator features;
+};
+
+struct plydata;
+struct splitpoint;
+class splitpool;
+class movegen;
+
+struct board : boardstate {
+
+	// allocated by the first search, see allocate_tables. set them before to share a table
+	shared_ptr<transtable> transposition_table;
+	shared_ptr<evalcache> eval_cache;
+	bool cache_evaluations = true;   // false evaluates every leaf
+
+	searchstats stats;
+
+	evaluator eval = network ? NETWORK : HANDCRAFTED;
+	bool probcut = false;   // prune with probcut_model, only where a tool asks for it
+
+	// set up by find_best, checked while searching
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max();
+	const atomic<bool>* stop = nullptr;
+	bool aborted = false;
+
+	// the parallel search, see PARALLEL SEARCH
+	splitpool* pool = nullptr;
+	const splitpoint* split = nullptr;   // the innermost split point this thread works under
+	bool reproducible = false;           // only use transposition entries of exactly the remaining depth
+
+	// repetitions. the keys of the positions before this one, oldest first: the moves of the
+	// game (see play_move) and then the search path. it is indexed by ply from the start of
+	// the game and reserved before a search, so it does not reallocate while searching
+	vector<uint64_t> key_history;
+	int reversible_plies = 0;                  // since the last capture, no position before that comes back
+	int repetition_index = NO_REPETITION;      // the oldest key_history index a draw below this node repeated
 
 
 
-	func make_move(movedata&);
-	func undo_move(movedata);
+	func make_move(const movedata&);
+	func undo_move(const movedata&);
+
+	// how the search makes and takes back moves, see ABALONE_COPY_MAKE
+	func push_move(const movedata&, plydata&) -> void;
+	func pop_move(const movedata&, plydata&) -> void;
+	func play_move(const movedata&) -> void;
+	func reserve_history() -> void;
+	func find_repetition() -> int;
+	func count_repetitions() -> int;
+	func path_dependent() -> bool;
 
 	func black_won();
 	func white_won();
 
+	// every change to pieces goes through these, they keep the hash and the network
+	// accumulator in step
+	func place_piece(point, piecedata) -> void;
+	func remove_piece(point) -> void;
+	func refresh_features() -> void;
+
+	func get_neighbor(int, dir) -> int;
 	func get_neighbor(point, dir) -> int;
-	func dirty_neighbors(point) -> void;
-	func update_neighbor(point, dir) -> int;
 
 	func update_hash(point, color);
-	func position_is_transposition();
-	func transposition_value();
-	func add_to_transposition_table(int);
+	func update_captured(color, int) -> void;
+	func compute_hash() -> uint64_t;
+	func verify_hash() -> void;
+	func add_to_transposition_table(int, bound, int, movedata);
+	func allocate_tables() -> void;
 
 	func evaluate() -> int;
-	func search(int, int, int) -> int;
+	func piece_score() -> int;
+	func captured_score() -> int;
+	func evaluate_cached() -> int;
+	func search(int, int, int, int) -> int;
+	func probcut_prune(int, int, int, int, int&) -> bool;
+	func search_root(int, movedata&) -> int;
+	func split_search(int, int, int, int, movegen&, movedata, int) -> int;
+	func work_on(splitpoint&, int shared_history = 0) -> void;
+	func should_stop() -> bool;
 	func find_best(int)->movedata;
+	func find_best(searchlimits)->movedata;
+
+	func search_lines(int, vector<rootline>&, int) -> void;
+	func principal_variation(movedata, int) -> vector<movedata>;
+	func find_best_lines(searchlimits, int)->vector<rootline>;
 
 
 	func find_random()->movedata;
 	func find_best_or_random()->movedata;
+	func legal_move(uint16_t)->movedata;
 
 
 	func print_board() -> void;
@@ -175,15 +451,18 @@ struct board {
 // and data
 
 
-let EMPTY_SPACE = piecedata{ EMPTY , array<char, 6> {char(0), char(0), char(0), char(0), char(0), char(0) },  array<bool, 6> {true, true, true, true, true, true} };
-let BLACK_PIECE = piecedata{ BLACK , array<char, 6> {char(0), char(0), char(0), char(0), char(0), char(0) },  array<bool, 6> {true, true, true, true, true, true} };
-let WHITE_PIECE = piecedata{ WHITE , array<char, 6> {char(0), char(0), char(0), char(0), char(0), char(0) },  array<bool, 6> {true, true, true, true, true, true} };
+let EMPTY_SPACE = piecedata{ EMPTY };
+let BLACK_PIECE = piecedata{ BLACK };
+let WHITE_PIECE = piecedata{ WHITE };
 
 let NONE_MOVE = movedata();
 
 let STARTING_BOARD = "B:BBBBBBBBBBB..BBB.............................WWW..WWWWWWWWWWW";
 let TESTING_BOARD = "B:...B..BBBB..BBBBB....BB.......B......WB.W..WW...W..WWWWWW.WWW";
 
+// white captures its sixth piece in 7 plies, a depth 5 search does not see it
+let SOLVE_BOARD = "W:....................BBBB....W.WW.....W.WB...BWWBW..B.BW....W.";
+
 
 
 let REVESER_LIST = array<dir, 6> { DOWN, BACK, LEFT, UP, FORWARD, RIGHT };
@@ -194,12 +473,84 @@ let ROWS_OFFSETS = array<int,9> { 0, 0, 0, 0, 0, 1, 2, 3, 4 };
 let INDEX_TO_LETTER = array<string, 9> { "A", "B", "C", "D", "E", "F", "G", "H", "I" };
 let INDEX_TO_NUMBER = array<string, 9> { "1", "2", "3", "4", "5", "6", "7", "8", "9" };
 
-let VADLID_SQUARES = array<array<bool, 9>, 9>{ array<bool, 9>{true, true, true, true, true, false, false, false, false}, array<bool, 9>{true, true, true, true, true, true, false, false, false}, array<bool, 9>{true, true, true, true, true, true, true, false, false}, array<bool, 9>{true, true, true, true, true, true, true, true, false}, array<bool, 9>{true, true, true, true, true, true, true, true, true}, array<bool, 9>{false, true, true, true, true, true, true, true, true}, array<bool, 9>{false, false, true, true, true, true, true, true, true}, array<bool, 9>{false, false, false, true, true, true, true, true, true}, array<bool, 9>{false, false, false, false, true, true, true, true, true} };
-let SCORE_MAP = array<array<int, 9>, 9> { array<int, 9>{-6, -6, -6, -6, -6, 0, 0, 0, 0}, array<int, 9>{-6, 1, 1, 1, 1, -6, 0, 0, 0}, array<int, 9>{-6, 1, 5, 5, 5, 1, -6, 0, 0}, array<int, 9>{-6, 1, 5, 3, 3, 5, 1, -6, 0}, array<int, 9>{-6, 1, 5, 3, 0, 3, 5, 1, -6}, array<int, 9>{0, -6, 1, 5, 3, 3, 5, 1, -6}, array<int, 9>{0, 0, -6, 1, 5, 5, 5, 1, -6}, array<int, 9>{0, 0, 0, -6, 1, 1, 1, 1, -6}, array<int, 9>{0, 0, 0, 0, -6, -6, -6, -6, -6} };
+constexpr let VADLID_SQUARES = array<array<bool, 9>, 9>{ array<bool, 9>{true, true, true, true, true, false, false, false, false}, array<bool, 9>{true, true, true, true, true, true, false, false, false}, array<bool, 9>{true, true, true, true, true, true, true, false, false}, array<bool, 9>{true, true, true, true, true, true, true, true, false}, array<bool, 9>{true, true, true, true, true, true, true, true, true}, array<bool, 9>{false, true, true, true, true, true, true, true, true}, array<bool, 9>{false, false, true, true, true, true, true, true, true}, array<bool, 9>{false, false, false, true, true, true, true, true, true}, array<bool, 9>{false, false, false, false, true, true, true, true, true} };
+constexpr let SCORE_MAP = array<array<int, 9>, 9> { array<int, 9>{-6, -6, -6, -6, -6, 0, 0, 0, 0}, array<int, 9>{-6, 1, 1, 1, 1, -6, 0, 0, 0}, array<int, 9>{-6, 1, 5, 5, 5, 1, -6, 0, 0}, array<int, 9>{-6, 1, 5, 3, 3, 5, 1, -6, 0}, array<int, 9>{-6, 1, 5, 3, 0, 3, 5, 1, -6}, array<int, 9>{0, -6, 1, 5, 3, 3, 5, 1, -6}, array<int, 9>{0, 0, -6, 1, 5, 5, 5, 1, -6}, array<int, 9>{0, 0, 0, -6, 1, 1, 1, 1, -6}, array<int, 9>{0, 0, 0, 0, -6, -6, -6, -6, -6} };
 let INWARDS_MAP = array<array<int, 9>, 9> { array<int, 9>{-1, -1, -1, -1, -1, 0, 0, 0, 0}, array<int, 9>{-1, 1, 1, 1, 1, -1, 0, 0, 0}, array<int, 9>{-1, 1, 3, 3, 3, 1, -1, 0, 0}, array<int, 9>{-1, 1, 3, 5, 5, 3, 1, -1, 0}, array<int, 9>{-1, 1, 3, 5, 7, 5, 3, 1, -1}, array<int, 9>{0, -1, 1, 3, 5, 5, 3, 1, -1}, array<int, 9>{0, 0, -1, 1, 3, 3, 3, 1, -1}, array<int, 9>{0, 0, 0, -1, 1, 1, 1, 1, -1}, array<int, 9>{0, 0, 0, 0, -1, -1, -1, -1, -1} };
 
+
+// geometry, generated at compile time from VADLID_SQUARES and DIRS
+
+constexpr func valid_cell(int x, int y) -> bool {
+	return x >= 0 && x < 9 && y >= 0 && y < 9 && VADLID_SQUARES[x][y];
+}
+
+// RAYS[cell][dir][d] is the cell d steps away in dir, d = 0 being the cell itself.
+// every step after leaving the board is OFF_BOARD, also from OFF_BOARD itself
+constexpr let RAYS = [] {
+	array<array<array<int8_t, 5>, 6>, CELLS + 1> rays{};
+	for (int cell = 0; cell <= CELLS; cell++) {
+		for (int dir = 0; dir < 6; dir++) {
+			var x = cell / 9, y = cell % 9;
+			var on_board = cell != OFF_BOARD && valid_cell(x, y);
+			for (int d = 0; d < 5; d++) {
+				rays[cell][dir][d] = int8_t(on_board ? x * 9 + y : OFF_BOARD);
+				x += DIRS[dir].x;
+				y += DIRS[dir].y;
+				on_board = on_board && valid_cell(x, y);
+			}
+		}
+	}
+	return rays;
+}();
+
+// how many steps in dir stay on the board
+constexpr let EDGE_DISTANCE = [] {
+	array<array<int8_t, 6>, CELLS> distances{};
+	for (int cell = 0; cell < CELLS; cell++) {
+		for (int dir = 0; dir < 6; dir++) {
+			var steps = 0;
+			while (valid_cell(cell / 9 + DIRS[dir].x * (steps + 1), cell % 9 + DIRS[dir].y * (steps + 1))) {
+				steps++;
+			}
+			distances[cell][dir] = int8_t(steps);
+		}
+	}
+	return distances;
+}();
+
+// VADLID_SQUARES with a margin of 4 cells on every side, so is_valid needs no bounds
+// check for any point at most 4 steps off the board
+let VALID_MARGIN = 4;
+let VALID_SIZE = 9 + 2 * VALID_MARGIN;
+constexpr let VALID_PADDED = [] {
+	array<bool, VALID_SIZE * VALID_SIZE> valid{};
+	for (int x = 0; x < VALID_SIZE; x++) {
+		for (int y = 0; y < VALID_SIZE; y++) {
+			valid[x * VALID_SIZE + y] = valid_cell(x - VALID_MARGIN, y - VALID_MARGIN);
+		}
+	}
+	return valid;
+}();
+
+// an empty board
+constexpr let EMPTY_CELLS = [] {
+	array<piecedata, CELLS + 1> cells{};
+	for (int i = 0; i < CELLS; i++) {
+		cells[i] = piecedata{ EMPTY };
+	}
+	cells[OFF_BOARD] = piecedata{ OUTSIDE };
+	return cells;
+}();
+
 let BLACK_PIECE_RANDOMS = array<uint64_t, 81>{ 11783152498764754964ull,9867829455511315619ull,9953171327645099357ull,10230630900545602954ull,11102429418757237286ull,11350259752494869987ull,11467272881717202554ull,11356642555556145607ull,11812603383225106406ull,11096409330424177249ull,13781805118507418293ull,12471865968944026484ull,9673720127685697236ull,13626237943228591603ull,11303210624070716086ull,13160847536653376646ull,13393811846437647898ull,10657426637371296306ull,10755195896827722928ull,9458204603351937453ull,12921212571068973295ull,13550225211166717028ull,12099414341044102258ull,11526969447764888394ull,11908810512577404677ull,10451341679312475918ull,11301084581107878659ull,10006312354074451749ull,12691585142716658303ull,11933176512198261560ull,9433884715535468742ull,9429342356176946875ull,10548896182922016207ull,10013099869414075073ull,10167888578794493837ull,11303849634804686333ull,10118660675244194786ull,13662584557934885822ull,9435638721905820797ull,11235078958594081182ull,13419505041365648673ull,9608237144802536248ull,10322681305975220883ull,13188015702987347907ull,9576579161821979690ull,13446277752215705410ull,9484220544563868019ull,9354140977878332379ull,10263961686532507291ull,13249504781537940243ull,11098647983862232251ull,12496116816804220936ull,12720074943079158622ull,11162019297037140609ull,13662194988197583121ull,10536317133337027215ull,9252174716792452343ull,9294258442456646586ull,10673134161247521303ull,10025921011931868104ull,12277094434512474741ull,12759221648540210377ull,9300663529115108601ull,11061126653644182366ull,11652264947928967488ull,9244017348478472533ull,13593155996171185529ull,13484130219249488737ull,13691048147066813283ull,13363552590376554307ull,10827649789896807957ull,12233347324514309796ull,9428091702473357442ull,10532017146898258264ull,13198887991073820392ull,13632423828222833010ull,12920573580477034444ull,12450210938822723412ull,13304009303463342020ull,9950994668981286941ull,9780068500029051552ull };
 let WHITE_PIECE_RANDOMS = array<uint64_t, 81>{ 9869392211838688588ull,10970277029028301506ull,10728175530471809336ull,12731481666958377818ull,13445274546292859355ull,12424050560076925568ull,12727958821627837224ull,10207967553728354183ull,11534449272969929532ull,11664674669121499684ull,11291518937054180427ull,12419937292961978843ull,11506605825583124351ull,10650990300564705766ull,12121825900449026452ull,10076132039376622579ull,12833407139387578922ull,10594219414472450146ull,13468604630704580399ull,11304554173993872290ull,9845079204038305393ull,9691490399063526239ull,13387208310818753362ull,10730900318181525421ull,12698187930809962626ull,11551130065519944473ull,9351870919478183414ull,12257983920306285737ull,11652965683511301762ull,12338613003757642871ull,13719613663318242781ull,12849366871892505291ull,10391643968421388466ull,9663454876402393887ull,13515087364573334400ull,13515403549079924542ull,12543296692248526984ull,12132467741030880234ull,12594922666579370006ull,12817678942017398393ull,11558575008189378483ull,11761541476457953505ull,10036916449940305772ull,10828519572091715078ull,11659433027104797275ull,11924559436095767181ull,10413453564177964539ull,13676301116728826959ull,11361561210068092198ull,9797753047888746007ull,11578705621285454127ull,11884229135252586245ull,10982733998208643292ull,10988800767842860943ull,13831429728857142990ull,10467404519904970528ull,11541909037446974052ull,10588652463993663706ull,12781589953466745131ull,11154475119862247315ull,10304171322672042193ull,11278634874100000857ull,13481919832032848457ull,12711935671227468246ull,12928939898585026338ull,9669031891010375855ull,12965755803904435008ull,12219584723983229849ull,11571965292062688098ull,13298421915966302174ull,13550470092093134076ull,12548598704541395783ull,11392679437668939295ull,12197492001238807990ull,13324130828672108844ull,12859966506837372548ull,12149482703062496625ull,13710605383790439429ull,11531606288508380890ull,11643511028142722172ull,10915808433911781394ull };
+// by number of captured pieces of that color
+let BLACK_CAPTURED_RANDOMS = array<uint64_t, 15>{ 6186480855544184806ull,2429905767007220651ull,6280523387295989344ull,2841697164436150513ull,7963928983688523790ull,4651319864817861085ull,1140216564282679268ull,9698442792196695118ull,15915824333088424980ull,14756782088516535284ull,12043836860421388275ull,14857233111931612507ull,16960835845078901684ull,17169538776554668159ull,1784037866458323960ull };
+let WHITE_CAPTURED_RANDOMS = array<uint64_t, 15>{ 159026439918855910ull,9483293329883552829ull,1783172822510795591ull,9136253550387537191ull,13485228203217933366ull,6289040531975882538ull,9152777805498567830ull,431105542966227313ull,18073821384484724815ull,1451050158274004957ull,6286227036905408328ull,10425364780473991206ull,8826194644415573259ull,6663490657838502919ull,5422611213324606989ull };
+let WHITE_TO_MOVE_KEY = 10635415005088634138ull;
+
+// keeps network and handcrafted evaluations of the same position apart in the eval cache
+let NETWORK_EVAL_KEY = 12345823573289462367ull;
 
 
 
@@ -245,10 +596,10 @@ func opposite(color c) -> color {
 }
 
 
+// only for points at most VALID_MARGIN steps off the board, which is every point
+// the move code computes
 func is_valid(int x, int y)  -> bool {
-	let x_in_bounds = (x >= 0 && x < 9);
-	let y_in_bounds = (y >= 0 && y < 9);
-	return x_in_bounds && y_in_bounds && VADLID_SQUARES[x][y];
+	return VALID_PADDED[(x + VALID_MARGIN) * VALID_SIZE + y + VALID_MARGIN];
 }
 
 func is_valid(point position)  -> bool {
@@ -266,6 +617,9 @@ func color_to_string(color color) -> string {
 
 	case EMPTY:
 		return ".";
+
+	case OUTSIDE:
+		break;
 	}
 	return " ";
 }
@@ -276,6 +630,42 @@ func print(type s) {
 }
 
 
+// counts every heap allocation, the benchmark checks that searching does not allocate
+atomic<uint64_t> allocations = 0;
+
+void* operator new(size_t size) {
+	allocations.fetch_add(1, memory_order_relaxed);
+	if (var memory = malloc(size ? size : 1)) {
+		return memory;
+	}
+	throw bad_alloc();
+}
+
+// std::stable_sort gets its buffer from here and frees it with the delete below
+void* operator new(size_t size, const nothrow_t&) noexcept {
+	allocations.fetch_add(1, memory_order_relaxed);
+	return malloc(size ? size : 1);
+}
+
+// gcc pairs new expressions with the free below once it is inlined and warns, the pairing is right
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+	free(memory);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+
 
 
 
@@ -323,175 +713,192 @@ func dirname(dir direction) {
 
 
 
-// array2d
-template<typename type, int x, int y>
-func& array2d<type, x, y>::operator[](int i) {
-	return inner[i];
+// cellarray
+cellarray::cellarray() : cells(EMPTY_CELLS) {
+}
+
+func cellarray::operator[](int x) -> piecedata* {
+	return &cells[x * 9];
+}
+
+func cellarray::operator[](point p) -> piecedata& {
+	return cells[p.x * 9 + p.y];
+}
+
+func cellarray::cell(int index) -> piecedata& {
+	return cells[index];
 }
 
-template<typename type, int x, int y>
-func& array2d<type, x, y>::operator[](point p) {
-	return inner[p.x][p.y];
+func cellarray::cell(int index) const -> const piecedata& {
+	return cells[index];
 }
 
 
 
 // movedata
 movedata::movedata() {
-	piececolor = EMPTY;
-	origin = point {0, 0};
-	direction = dir(0);
-	pulled_neighbors = 0;
-	pulled_direction = dir(0);
 }
 
-movedata::movedata(color input_color, point input_origin, dir input_direction, int input_pulled_neighbors) {
-	piececolor = input_color;
-
-	origin = input_origin;
-	direction = input_direction;
+movedata::movedata(color input_color, point input_origin, dir input_direction, int input_pulled_neighbors)
+	: movedata(input_color, input_origin, input_direction, input_pulled_neighbors, opposite(input_direction), 0, false) {
+}
 
-	pulled_neighbors = input_pulled_neighbors;
-	pulled_direction = opposite(input_direction);
+movedata::movedata(color input_color, point input_origin, dir input_direction, int input_pulled_neighbors, dir input_pulled_direction)
+	: movedata(input_color, input_origin, input_direction, input_pulled_neighbors, input_pulled_direction, 0, false) {
+}
 
-	score = evaluate();
+movedata::movedata(color input_color, point input_origin, dir input_direction, int input_pulled_neighbors, bool capture, int pushed)
+	: movedata(input_color, input_origin, input_direction, input_pulled_neighbors, opposite(input_direction), pushed, capture) {
 }
 
-movedata::movedata(color input_color, point input_origin, dir input_direction, int input_pulled_neighbors, dir input_pulled_direction) {
-	piececolor = input_color;
+movedata::movedata(color input_color, point input_origin, dir input_direction, int input_pulled_neighbors, dir input_pulled_direction, int pushed, bool capture) {
+	bits = uint32_t(input_origin.x * 9 + input_origin.y)
+		| uint32_t(input_direction) << 7
+		| uint32_t(input_pulled_neighbors) << 10
+		| uint32_t(input_pulled_direction) << 12
+		| uint32_t(pushed) << 15
+		| uint32_t(capture) << 17
+		| uint32_t(input_color & 3) << 18;
+}
 
-	origin = input_origin;
-	direction = input_direction;
+func movedata::piececolor() const -> color {
+	let raw = int(bits >> 18 & 3);
+	return color(raw == 3 ? -1 : raw);
+}
 
-	pulled_neighbors = input_pulled_neighbors;
-	pulled_direction = input_pulled_direction;
+func movedata::origin() const -> point {
+	let index = int(bits & 127);
+	return point{ index / 9, index % 9 };
+}
 
-	score = evaluate();
+func movedata::direction() const -> dir {
+	return dir(bits >> 7 & 7);
 }
 
-movedata::movedata(color input_color, point input_origin, dir input_direction, int input_pulled_neighbors, bool capture, int pushed) {
-	piececolor = input_color;
+func movedata::pulled_neighbors() const -> int {
+	return int(bits >> 10 & 3);
+}
 
-	origin = input_origin;
-	direction = input_direction;
+func movedata::pulled_direction() const -> dir {
+	return dir(bits >> 12 & 7);
+}
 
-	pulled_neighbors = input_pulled_neighbors;
-	pulled_direction = opposite(input_direction);
+func movedata::pushed_enemies() const -> int {
+	return int(bits >> 15 & 3);
+}
 
-	captured_enemy = capture;
-	pushed_enemies = pushed;
+func movedata::captured_enemy() const -> bool {
+	return bits >> 17 & 1;
+}
 
-	score = evaluate();
+func movedata::id() const -> uint16_t {
+	return uint16_t(bits & 0x7fff);
 }
 
-func movedata::is_valid() -> bool {
-	return not (piececolor == EMPTY);
+func movedata::is_valid() const -> bool {
+	return not (piececolor() == EMPTY);
 }
 
-func movedata::repr() -> string {
-	return "from: " + origin.repr() + ", in dir: " + dirname(direction) + ", with " + to_string(pulled_neighbors) + " pulled from dir: " + dirname(pulled_direction);
+func movedata::repr() const -> string {
+	return "from: " + origin().repr() + ", in dir: " + dirname(direction()) + ", with " + to_string(pulled_neighbors()) + " pulled from dir: " + dirname(pulled_direction());
 }
 
-func movedata::evaluate() -> int {
-	if (captured_enemy) {
+func movedata::evaluate() const -> int {
+	if (captured_enemy()) {
 		return 100;
 	}
 	else {
-		let target = origin + DIRS[direction];
+		let start = origin();
+		let target = start + DIRS[direction()];
 
-		let start_value = INWARDS_MAP[origin.x][origin.y];
+		let start_value = INWARDS_MAP[start.x][start.y];
 		let end_value = INWARDS_MAP[target.x][target.y];
 
-		if (pushed_enemies > 0) {
-			return pulled_neighbors + pushed_enemies + start_value - end_value;
+		if (pushed_enemies() > 0) {
+			return pulled_neighbors() + pushed_enemies() + start_value - end_value;
 		}
 		else {
-			return pulled_neighbors + end_value - start_value;
+			return pulled_neighbors() + end_value - start_value;
 		}
 	}
 }
 
-func better_move(movedata smaller, movedata bigger) {
-	return smaller.score < bigger.score;
-}
-
 
 
-// board
-func board::black_won() {
-	return captured_white_pieces >= 6;
+// transtable
+transtable::transtable(int size_log2) : slots(size_t(1) << size_log2) {
+	mask = slots.size() - 1;
 }
 
-func board::white_won() {
-	return captured_black_pieces >= 6;
+func transtable::probe(uint64_t key) -> ttentry {
+	let& slot = slots[key & mask];
+	let data = slot.data.load(memory_order_relaxed);
+	if ((slot.check.load(memory_order_relaxed) ^ data) != key) {
+		return ttentry();
+	}
+	return ttentry{ int(uint32_t(data)), uint16_t(data >> 32), int8_t(data >> 48), bound(data >> 56) };
 }
 
-func board::get_neighbor(point position, dir direction) -> int {
-	var target_piece = pieces[position];
+func transtable::store(uint64_t key, int score, bound kind, int depth, movedata move) -> void {
+	let data = uint64_t(uint32_t(score)) | uint64_t(move.id()) << 32 | uint64_t(uint8_t(depth)) << 48 | uint64_t(kind) << 56;
+	var& slot = slots[key & mask];
+	slot.check.store(key ^ data, memory_order_relaxed);
+	slot.data.store(data, memory_order_relaxed);
+}
 
-	// if entry in the table is no longer up to date, update it
-	if (target_piece.dirtyflags[direction]) {
-		return update_neighbor(position, direction);
-	}
-	// if entry in the table is up to date, just return it
-	else {
-		return target_piece.neighbors[direction];
+func transtable::clear() -> void {
+	for (var& slot in slots) {
+		slot.check = 0;
+		slot.data = 0;
 	}
 }
 
-func board::dirty_neighbors(point position) -> void {
-	var& origin_piece = pieces[position];
-	var  origin_color = origin_piece.piececolor;
-
-	origin_piece.dirtyflags = array<bool, 6>{ true, true, true, true, true, true };
-
-	for (var dir in dirs) {
-		var  close_target_position = position - DIRS[dir];
-		if (not is_valid(close_target_position)) continue;
-
-		var& close_target_pice = pieces[close_target_position];
-		var  close_target_color = close_target_pice.piececolor;
 
-		if (close_target_color == origin_color || close_target_color == EMPTY) {
-			close_target_pice.dirtyflags[dir] = true;
-		}
-
-
-		var  far_target_position = position - DIRS[dir] * 2;
-		if (not is_valid(far_target_position)) continue;
-
-		var& far_target_pice = pieces[far_target_position];
-		var  far_target_color = close_target_pice.piececolor;
-
-		if (far_target_color == origin_color || far_target_color == EMPTY) {
-			far_target_pice.dirtyflags[dir] = true;
-		}
+// evalcache
+evalcache::evalcache(int size_log2) : slots(size_t(1) << size_log2) {
+	mask = slots.size() - 1;
+}
 
+func evalcache::probe(uint64_t key, int& score) -> bool {
+	let& slot = slots[key & mask];
+	let data = slot.data.load(memory_order_relaxed);
+	if ((slot.check.load(memory_order_relaxed) ^ data) != key || not (data >> 32)) {
+		return false;
 	}
+	score = int(uint32_t(data));
+	return true;
+}
+
+func evalcache::store(uint64_t key, int score) -> void {
+	let data = uint64_t(uint32_t(score)) | uint64_t(1) << 32;
+	var& slot = slots[key & mask];
+	slot.check.store(key ^ data, memory_order_relaxed);
+	slot.data.store(data, memory_order_relaxed);
 }
 
-func board::update_neighbor(point position, dir direction) -> int {
-	var& update_piece = pieces[position];
 
-	let close_target_position = position + DIRS[direction];
 
-	if (is_valid(close_target_position) && pieces[close_target_position].piececolor == update_piece.piececolor) {
-		let far_target_position = position + DIRS[direction] * 2;
+// board
+func board::black_won() {
+	return captured_white_pieces >= 6;
+}
 
-		if (is_valid(far_target_position) && pieces[far_target_position].piececolor == update_piece.piececolor) {
-			update_piece.neighbors[direction] = 2;
-		}
-		else {
-			update_piece.neighbors[direction] = 1;
-		}
-	}
-	else {
-		update_piece.neighbors[direction] = 0;
-	}
+func board::white_won() {
+	return captured_black_pieces >= 6;
+}
 
-	update_piece.dirtyflags[direction] = false;
-	return update_piece.neighbors[direction];
+// how many pieces of the same color follow in that direction, at most 2. for an empty
+// cell, how many empty cells follow
+func board::get_neighbor(int cell, dir direction) -> int {
+	let& ray = RAYS[cell][direction];
+	let own = pieces.cell(ray[0]).piececolor;
+	let first = int(pieces.cell(ray[1]).piececolor == own);
+	let second = int(pieces.cell(ray[2]).piececolor == own);
+	return first + (first & second);
+}
 
+func board::get_neighbor(point position, dir direction) -> int {
+	return get_neighbor(position.x * 9 + position.y, direction);
 }
 
 func board::update_hash(point position, color c) {
@@ -506,17 +913,69 @@ func board::update_hash(point position, color c) {
 	}
 }
 
-func board::position_is_transposition() {
-	// return false;
-	return transposition_table.find(boardhash) != transposition_table.end();
+func board::place_piece(point position, piecedata piece) -> void {
+	pieces[position] = piece;
+	update_hash(position, piece.piececolor);
+	if (network) {
+		network->add(features, position, piece.piececolor);
+	}
+}
+
+func board::remove_piece(point position) -> void {
+	let piececolor = pieces[position].piececolor;
+	update_hash(position, piececolor);
+	if (network) {
+		network->remove(features, position, piececolor);
+	}
+	pieces[position] = EMPTY_SPACE;
+}
+
+func board::refresh_features() -> void {
+	if (network) {
+		network->refresh(features, pieces);
+	}
+}
+
+// changes the captured count of a color by the given amount
+func board::update_captured(color piececolor, int change) -> void {
+	var& count = piececolor == BLACK ? captured_black_pieces : captured_white_pieces;
+	let& randoms = piececolor == BLACK ? BLACK_CAPTURED_RANDOMS : WHITE_CAPTURED_RANDOMS;
+
+	boardhash ^= randoms[count];
+	count += change;
+	boardhash ^= randoms[count];
+}
+
+// the key from scratch. make_move and undo_move keep boardhash equal to this
+func board::compute_hash() -> uint64_t {
+	uint64_t hash = 0;
+	for (int x in range(9)) {
+		for (int y in range(9)) {
+			let piececolor = pieces[x][y].piececolor;
+			if (piececolor == BLACK) hash ^= BLACK_PIECE_RANDOMS[x * 9 + y];
+			if (piececolor == WHITE) hash ^= WHITE_PIECE_RANDOMS[x * 9 + y];
+		}
+	}
+
+	hash ^= BLACK_CAPTURED_RANDOMS[captured_black_pieces] ^ WHITE_CAPTURED_RANDOMS[captured_white_pieces];
+	if (current_turn == WHITE) {
+		hash ^= WHITE_TO_MOVE_KEY;
+	}
+	return hash;
 }
 
-func board::transposition_value() {
-	return  transposition_table[boardhash];
+func board::add_to_transposition_table(int score, bound kind, int depth, movedata bestmove) {
+	transposition_table->store(boardhash, score, kind, depth, bestmove);
 }
 
-func board::add_to_transposition_table(int score) {
-	transposition_table[boardhash] = score;
+// most boards never search, the tables are only made for the ones that do
+func board::allocate_tables() -> void {
+	if (not transposition_table) {
+		transposition_table = make_shared<transtable>();
+	}
+	if (cache_evaluations && not eval_cache) {
+		eval_cache = make_shared<evalcache>();
+	}
 }
 
 func board::print_board() -> void {
@@ -576,17 +1035,44 @@ func parse_to_board(string s) {
 	ret.captured_black_pieces = 14 - black_pieces;
 	ret.captured_white_pieces = 14 - white_pieces;
 
-	for (int x in range(9)) {
-		for (int y in range(9)) {
-			for (var dir in dirs) {
-				ret.update_neighbor(point{ x, y }, dir);
+	ret.boardhash = ret.compute_hash();
+	ret.refresh_features();
+
+	// room for the searches of a short game, search_root grows it if needed
+	ret.key_history.reserve(4 * MAX_PLY);
+
+	return ret;
+
+
+}
+
+func serialize_board(board& b) -> string {
+	var ret = string(b.current_turn == WHITE ? "W:" : "B:");
+
+	for (int i in range(9)) {
+		for (int j in range(ROWS_LENGTH[i])) {
+			switch (b.pieces[j + ROWS_OFFSETS[i]][i].piececolor) {
+				nextcase BLACK:
+				ret += 'B';
+				nextcase WHITE:
+				ret += 'W';
+				nextcase EMPTY:
+				ret += '.';
+				nextcase OUTSIDE:
+				break;
 			}
 		}
 	}
 
 	return ret;
+}
 
-
+// the ABALONE_VERIFY_HASH check at every node
+func board::verify_hash() -> void {
+	if (boardhash != compute_hash()) {
+		cerr << "boardhash " << boardhash << " differs from " << compute_hash() << " in " << serialize_board(*this) << "\n";
+		abort();
+	}
 }
 
 func serilize_move(movedata move) -> string {
@@ -597,14 +1083,14 @@ func serilize_move(movedata move) -> string {
 
 	};
 
-	let strait_move = (opposite(move.direction) == move.pulled_direction);
+	let strait_move = (opposite(move.direction()) == move.pulled_direction());
 	if (strait_move) {
 
-		let initial_offset = DIRS[move.pulled_direction] * move.pulled_neighbors;
-		let propper_origin = move.origin + initial_offset;
+		let initial_offset = DIRS[move.pulled_direction()] * move.pulled_neighbors();
+		let propper_origin = move.origin() + initial_offset;
 		let first = position_to_string(propper_origin);
 
-		let move_offset = DIRS[move.direction];
+		let move_offset = DIRS[move.direction()];
 		let propper_target = propper_origin + move_offset;
 		let last = position_to_string(propper_target);
 
@@ -613,14 +1099,14 @@ func serilize_move(movedata move) -> string {
 	}
 	else {
 
-		let propper_origin = move.origin;
+		let propper_origin = move.origin();
 		let first = position_to_string(propper_origin);
 
-		let broadside_offset = DIRS[move.pulled_direction] * move.pulled_neighbors;
+		let broadside_offset = DIRS[move.pulled_direction()] * move.pulled_neighbors();
 		let broadside_endpos = propper_origin + broadside_offset;
 		let second = position_to_string(broadside_endpos);
 
-		let move_offset = DIRS[move.direction];
+		let move_offset = DIRS[move.direction()];
 		let propper_target = propper_origin + move_offset;
 		let last = position_to_string(propper_target);
 
@@ -633,69 +1119,427 @@ func serilize_move(movedata move) -> string {
 
 
 
-////////////////
-// STRATEGY CODE
-// includes some implementation for board
+///////
+// NNUE
+// efficiently updatable neural network evaluation. 162 inputs (color, cell) feed
+// 32 int16 sums that live in the position and change with every placed or removed
+// piece, so a leaf only runs the two small int8 layers after them:
+//  accumulator -> clamp to 0..127 -> 32x32 int8 -> >>6, clamp to 0..127 -> 32 int8 -> >>6
+// the result is from black's side like evaluate(), captures are still scored by hand
 
-class movegen {
-private:
-	vector<movedata> moves;
-	int picked_moves = 0;
-public:
-	init movegen(board* board) {
-		generate(board);
-	}
+let NNUE_MAGIC = string("ABNN1");
 
-	func generate(board* board) -> void {
+func feature_index(point position, color piececolor) -> int {
+	return (piececolor == BLACK ? 0 : 81) + position.x * 9 + position.y;
+}
 
-		// separate out a partial function to decrease nesting
-		func generate_for_target_position = lambda(int x, int y) {
+// weights file: the magic, then every array in declaration order, little endian
+func nnue::load(string path) -> bool {
+	var file = ifstream(path, ios::binary);
+	var magic = string(NNUE_MAGIC.size(), ' ');
+	if (not file.read(magic.data(), magic.size()) || magic != NNUE_MAGIC) return false;
+
+	file.read(reinterpret_cast<char*>(input_weights.data()), sizeof(input_weights));
+	file.read(reinterpret_cast<char*>(input_bias.data()), sizeof(input_bias));
+	file.read(reinterpret_cast<char*>(hidden_weights.data()), sizeof(hidden_weights));
+	file.read(reinterpret_cast<char*>(hidden_bias.data()), sizeof(hidden_bias));
+	file.read(reinterpret_cast<char*>(output_weights.data()), sizeof(output_weights));
+	file.read(reinterpret_cast<char*>(&output_bias), sizeof(output_bias));
+	return bool(file);
+}
 
-			let move_origin = point{ x, y };
-			let moved_piece = board->pieces[move_origin];
+func nnue::save(string path) const -> bool {
+	var file = ofstream(path, ios::binary);
+	file.write(NNUE_MAGIC.data(), NNUE_MAGIC.size());
+	file.write(reinterpret_cast<const char*>(input_weights.data()), sizeof(input_weights));
+	file.write(reinterpret_cast<const char*>(input_bias.data()), sizeof(input_bias));
+	file.write(reinterpret_cast<const char*>(hidden_weights.data()), sizeof(hidden_weights));
+	file.write(reinterpret_cast<const char*>(hidden_bias.data()), sizeof(hidden_bias));
+	file.write(reinterpret_cast<const char*>(output_weights.data()), sizeof(output_weights));
+	file.write(reinterpret_cast<const char*>(&output_bias), sizeof(output_bias));
+	return bool(file);
+}
 
-			if (moved_piece.piececolor != board->current_turn) {
-				return;
+func nnue::refresh(accumulator& acc, const cellarray& pieces) const -> void {
+	acc.values = input_bias;
+	for (int x in range(9)) {
+		for (int y in range(9)) {
+			let piececolor = pieces.cell(x * 9 + y).piececolor;
+			if (piececolor != EMPTY) {
+				add(acc, point{ x, y }, piececolor);
 			}
+		}
+	}
+}
 
-			for (var dir in dirs) {
-				let target_position = move_origin + DIRS[dir];
-				if (not is_valid(target_position)) continue;
-
-				let target_piece = board->pieces[target_position];
+func nnue::add(accumulator& acc, point position, color piececolor) const -> void {
+	let weights = &input_weights[feature_index(position, piececolor) * NNUE_HIDDEN];
+#ifdef __AVX2__
+	for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+		let sum = _mm256_add_epi16(_mm256_load_si256((const __m256i*)&acc.values[i]), _mm256_load_si256((const __m256i*)&weights[i]));
+		_mm256_store_si256((__m256i*)&acc.values[i], sum);
+	}
+#else
+	for (int i in range(NNUE_HIDDEN)) {
+		acc.values[i] += weights[i];
+	}
+#endif
+}
 
-				// if target square is friendly
-				if (target_piece.piececolor == board->current_turn) {
-					continue;
-				}
+func nnue::remove(accumulator& acc, point position, color piececolor) const -> void {
+	let weights = &input_weights[feature_index(position, piececolor) * NNUE_HIDDEN];
+#ifdef __AVX2__
+	for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+		let difference = _mm256_sub_epi16(_mm256_load_si256((const __m256i*)&acc.values[i]), _mm256_load_si256((const __m256i*)&weights[i]));
+		_mm256_store_si256((__m256i*)&acc.values[i], difference);
+	}
+#else
+	for (int i in range(NNUE_HIDDEN)) {
+		acc.values[i] -= weights[i];
+	}
+#endif
+}
 
-				let moved_support = board->get_neighbor(move_origin, opposite(dir));
+#ifdef __AVX2__
+// 32 unsigned 0..127 activations times 32 int8 weights, summed. the pairwise int16 sums
+// of maddubs stay below 2 * 127 * 128, so they never saturate and match the scalar code
+func dot32(__m256i activations, const int8_t* weights) -> int {
+	let products = _mm256_maddubs_epi16(activations, _mm256_load_si256((const __m256i*)weights));
+	let sums = _mm256_madd_epi16(products, _mm256_set1_epi16(1));
+	let half = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+	let quarter = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtsi128_si32(_mm_add_epi32(quarter, _mm_shuffle_epi32(quarter, _MM_SHUFFLE(2, 3, 0, 1))));
+}
+#endif
 
+func nnue::evaluate(const accumulator& acc) const -> int {
+	alignas(32) array<uint8_t, NNUE_L2> hidden;
 
-				// if target square is empty
-				if (target_piece.piececolor == EMPTY) {
+#ifdef __AVX2__
+	static_assert(NNUE_HIDDEN == 32 && NNUE_L2 == 32, "the avx2 kernels handle exactly one register of activations");
 
-					// all strait moves
-					for (int i in range(moved_support + 1)) {
-						var move = movedata(board->current_turn, point{ x, y }, dir, i);
-						moves.push_back(move);
-					}
+	// packs works per 128 bit lane, the permute puts the bytes back in order
+	let low = _mm256_load_si256((const __m256i*)&acc.values[0]);
+	let high = _mm256_load_si256((const __m256i*)&acc.values[16]);
+	let packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), _MM_SHUFFLE(3, 1, 2, 0));
+	let activations = _mm256_max_epi8(packed, _mm256_setzero_si256());
 
-					// all broadside moves
-					for (var pull_dir in half_dirs) {
+	for (int j in range(NNUE_L2)) {
+		let sum = hidden_bias[j] + dot32(activations, &hidden_weights[j * NNUE_HIDDEN]);
+		hidden[j] = uint8_t(clamp(sum >> NNUE_SHIFT, 0, 127));
+	}
 
-						if (pull_dir == dir || pull_dir == opposite(dir)) {
-							continue;
-						}
+	let output = output_bias + dot32(_mm256_load_si256((const __m256i*)hidden.data()), output_weights.data());
+#else
+	var input = array<uint8_t, NNUE_HIDDEN>();
+	for (int i in range(NNUE_HIDDEN)) {
+		input[i] = uint8_t(clamp(int(acc.values[i]), 0, 127));
+	}
 
+	for (int j in range(NNUE_L2)) {
+		var sum = hidden_bias[j];
+		for (int i in range(NNUE_HIDDEN)) {
+			sum += input[i] * hidden_weights[j * NNUE_HIDDEN + i];
+		}
+		hidden[j] = uint8_t(clamp(sum >> NNUE_SHIFT, 0, 127));
+	}
 
+	var output = output_bias;
+	for (int j in range(NNUE_L2)) {
+		output += hidden[j] * output_weights[j];
+	}
+#endif
 
-						let target_neighbors = board->get_neighbor(target_position, pull_dir);
-						let moved_neighbors = board->get_neighbor(move_origin, pull_dir);
-						let min_neighbors = min(moved_neighbors, target_neighbors);
+	return output >> NNUE_SHIFT;
+}
 
-						for (int i in range(min_neighbors)) {
-							var move = movedata(board->current_turn, point{ x, y }, dir, i + 1, pull_dir);
+// a starting point for training, not a trained network: SCORE_MAP split into its
+// positive and negative part for each color, which the int8 layers pass through
+// unchanged. it evaluates exactly like the positional part of evaluate()
+func seed_network() -> unique_ptr<nnue> {
+	var net = make_unique<nnue>();
+	net->input_weights.fill(0);
+	net->input_bias.fill(0);
+	net->hidden_weights.fill(0);
+	net->hidden_bias.fill(0);
+	net->output_weights.fill(0);
+	net->output_bias = 0;
+
+	let one = int8_t(1 << NNUE_SHIFT);
+	for (int x in range(9)) {
+		for (int y in range(9)) {
+			let value = SCORE_MAP[x][y];
+			let black = &net->input_weights[feature_index(point{ x, y }, BLACK) * NNUE_HIDDEN];
+			let white = &net->input_weights[feature_index(point{ x, y }, WHITE) * NNUE_HIDDEN];
+			black[value > 0 ? 0 : 1] = int16_t(abs(value));
+			white[value > 0 ? 2 : 3] = int16_t(abs(value));
+		}
+	}
+
+	let signs = array<int, 4>{ 1, -1, -1, 1 };
+	for (int i in range(4)) {
+		net->hidden_weights[i * NNUE_HIDDEN + i] = one;
+		net->output_weights[i] = int8_t(signs[i] * one);
+	}
+	return net;
+}
+
+func load_network(string path) -> bool {
+	var net = make_unique<nnue>();
+	if (not net->load(path)) {
+		cerr << "could not read a network from " << path << "\n";
+		return false;
+	}
+	network = move(net);
+	return true;
+}
+
+
+
+/////////////////////
+// PARALLEL SEARCH
+// young brothers wait. a node searches its eldest child alone, then the rest of its
+// moves become a split point that idle helper threads take moves from, one at a time.
+// alpha is shared through the split point, and a beta cutoff cancels everything
+// searched below it. with board::reproducible the score and the best root move are the
+// same for any number of threads, only the node count changes. the search side of it
+// is board::split_search and board::work_on, next to board::search
+
+let SPLIT_DEPTH = 3;   // smaller subtrees are not worth handing to another thread
+
+struct splitpoint {
+	boardstate position;         // the node, helpers search its children from a copy
+	const board* owner;
+	const splitpoint* parent;    // a cutoff there cancels this one too
+	int beta;
+	int depthleft;
+	int ply;
+	int history_size;            // of the owner's key_history, helpers copy that much
+	int reversible_plies;
+
+	array<movedata, MAX_SEARCHED_MOVES> moves;
+	int count = 0;
+	atomic<int> next = 0;        // the next move to hand out
+
+	mutex lock;                  // for the results below
+	atomic<int> alpha;
+	movedata bestmove;
+	atomic<bool> cutoff = false;
+	int repetition_index;        // see board::repetition_index, the minimum over all moves
+
+	atomic<int> working = 0;     // helpers still on it, the owner waits for them
+
+	func cancelled() const -> bool {
+		for (var point = this; point; point = point->parent) {
+			if (point->cutoff.load(memory_order_relaxed)) return true;
+		}
+		return false;
+	}
+};
+
+// the helper threads of one search and the split points they may take work from
+class splitpool {
+private:
+	vector<board> helpers;       // copied from the searching board, so they share its tables
+	vector<thread> threads;
+
+	mutex lock;
+	condition_variable wake;
+	condition_variable changed;   // a helper finished a move or a split point was published, for waiting owners
+	vector<splitpoint*> available;
+	atomic<int> idle = 0;
+	bool quitting = false;
+
+	// the oldest split point with moves left, it has the largest subtrees
+	func find_work() -> splitpoint* {
+		for (var point in available) {
+			if (point->next.load() < point->count && not point->cancelled()) return point;
+		}
+		return nullptr;
+	}
+
+	// a split point with moves left that the helpers of point opened below it
+	func find_work_below(const splitpoint& point) -> splitpoint* {
+		for (var candidate in available) {
+			if (candidate->next.load() >= candidate->count || candidate->cancelled()) continue;
+			for (var parent = candidate->parent; parent; parent = parent->parent) {
+				if (parent == &point) return candidate;
+			}
+		}
+		return nullptr;
+	}
+
+	func helper_loop(board& helper) -> void {
+		loop() {
+			var point = (splitpoint*)nullptr;
+			{
+				var guard = unique_lock(lock);
+				idle++;
+				wake.wait(guard, lambda() { return quitting || (point = find_work()) != nullptr; });
+				idle--;
+				if (quitting) return;
+				point->working++;
+			}
+
+			helper.work_on(*point);
+			nodes += helper.stats.nodes;
+			helper.stats.nodes = 0;
+			helper.aborted = false;
+
+			// the owner may return as soon as this reaches 0
+			{
+				var guard = lock_guard(lock);
+				point->working--;
+			}
+			changed.notify_all();
+		}
+	}
+
+public:
+	atomic<uint64_t> nodes = 0;   // searched by the helpers
+
+	init splitpool(board& owner, int count) : helpers(count, owner) {
+		for (var& helper in helpers) {
+			helper.pool = this;
+			helper.stats = searchstats();
+			helper.key_history.reserve(owner.key_history.size() + MAX_PLY);
+		}
+		for (var& helper in helpers) {
+			threads.emplace_back(lambda() { helper_loop(helper); });
+		}
+	}
+
+	~splitpool() {
+		{
+			var guard = lock_guard(lock);
+			quitting = true;
+		}
+		wake.notify_all();
+		for (var& thread in threads) {
+			thread.join();
+		}
+	}
+
+	func has_idle() -> bool {
+		return idle.load(memory_order_relaxed) > 0;
+	}
+
+	func publish(splitpoint* point) -> void {
+		{
+			var guard = lock_guard(lock);
+			available.push_back(point);
+		}
+		wake.notify_all();
+		changed.notify_all();
+	}
+
+	// the owner of point, out of moves, works below it for its helpers until they are done
+	func wait_for_helpers(board& owner, splitpoint& point) -> void {
+		loop() {
+			var child = (splitpoint*)nullptr;
+			{
+				var guard = unique_lock(lock);
+				changed.wait(guard, lambda() { return point.working.load() == 0 || (child = find_work_below(point)) != nullptr; });
+				if (not child) return;
+				child->working++;
+			}
+
+			// the child's owner searched from this point, so the keys up to it are already the same
+			owner.work_on(*child, point.history_size);
+
+			// work_on moved the owner to the child's position, back to its own
+			static_cast<boardstate&>(owner) = point.position;
+			owner.key_history.resize(point.history_size);
+			owner.reversible_plies = point.reversible_plies;
+			owner.aborted = false;
+
+			{
+				var guard = lock_guard(lock);
+				child->working--;
+			}
+			changed.notify_all();
+		}
+	}
+
+	func retract(splitpoint* point) -> void {
+		var guard = lock_guard(lock);
+		available.erase(find(available.begin(), available.end(), point));
+	}
+};
+
+
+
+////////////////
+// STRATEGY CODE
+// includes some implementation for board
+
+class movegen {
+private:
+	movelist& moves;
+	int picked_moves = 0;
+public:
+	init movegen(board* board, movelist& list, uint16_t hashmove = 0) : moves(list) {
+		moves.count = 0;
+		generate(board);
+
+		// the best move found the last time this position was searched goes first
+		for (int i in range(moves.size())) {
+			if (hashmove != 0 && moves[i].id() == hashmove) {
+				moves.scores[i] = INT16_MAX;
+			}
+		}
+	}
+
+	func generate(board* board) -> void {
+
+		// separate out a partial function to decrease nesting
+		func generate_for_target_position = lambda(int x, int y) {
+
+			let move_origin = x * 9 + y;
+			let moved_piece = board->pieces.cell(move_origin);
+
+			if (moved_piece.piececolor != board->current_turn) {
+				return;
+			}
+
+			for (var dir in dirs) {
+				let target_position = int(RAYS[move_origin][dir][1]);
+				if (target_position == OFF_BOARD) continue;
+
+				let target_piece = board->pieces.cell(target_position);
+
+				// if target square is friendly
+				if (target_piece.piececolor == board->current_turn) {
+					continue;
+				}
+
+				let moved_support = board->get_neighbor(move_origin, opposite(dir));
+
+
+				// if target square is empty
+				if (target_piece.piececolor == EMPTY) {
+
+					// all strait moves
+					for (int i in range(moved_support + 1)) {
+						var move = movedata(board->current_turn, point{ x, y }, dir, i);
+						moves.push_back(move);
+					}
+
+					// all broadside moves
+					for (var pull_dir in half_dirs) {
+
+						if (pull_dir == dir || pull_dir == opposite(dir)) {
+							continue;
+						}
+
+
+
+						let target_neighbors = board->get_neighbor(target_position, pull_dir);
+						let moved_neighbors = board->get_neighbor(move_origin, pull_dir);
+						let min_neighbors = min(moved_neighbors, target_neighbors);
+
+						for (int i in range(min_neighbors)) {
+							var move = movedata(board->current_turn, point{ x, y }, dir, i + 1, pull_dir);
 							moves.push_back(move);
 						}
 					}
@@ -707,12 +1551,13 @@ public:
 					let target_neighbors = board->get_neighbor(target_position, dir);
 					let strength_difference = moved_support - target_neighbors;
 
+					// where the last pushed piece goes, off the board is a capture
+					let pushed_to_position = int(RAYS[target_position][dir][target_neighbors + 1]);
+					let capture = EDGE_DISTANCE[target_position][dir] <= target_neighbors;
+					let valid_push = capture || (board->pieces.cell(pushed_to_position).piececolor == EMPTY);
+
 					// if the target is an enemy, we must overpower by one or two
 					if (strength_difference >= 1) {
-						var pushed_to_position = target_position + DIRS[dir] * (target_neighbors + 1);
-						var capture = not is_valid(pushed_to_position);
-
-						var valid_push = capture || (board->pieces[pushed_to_position].piececolor == EMPTY);
 						if (valid_push) {
 
 							var move = movedata(board->current_turn, point{ x, y }, dir, target_neighbors + 1, capture, target_neighbors + 1);
@@ -721,10 +1566,6 @@ public:
 					}
 
 					if (strength_difference >= 2) {
-						var pushed_to_position = target_position + DIRS[dir] * (target_neighbors + 1);
-						var capture = not is_valid(pushed_to_position);
-
-						var valid_push = capture || (board->pieces[pushed_to_position].piececolor == EMPTY);
 						if (valid_push) {
 
 							var move = movedata(board->current_turn, point{ x, y }, dir, target_neighbors + 2, capture, target_neighbors + 1);
@@ -741,29 +1582,55 @@ public:
 				generate_for_target_position(x, y);
 			}
 		}
-
-		// best moves are executed first for alpha beta pruning optimisation 
-		sort(moves.begin(), moves.end(), better_move);
 	}
 
+	// best moves are executed first for alpha beta pruning optimisation.
+	// only the picked moves are ordered, one selection step at a time. the pick is moved
+	// up without swapping, so equal scores stay in the order they were generated in and
+	// earlier picks do not decide between them
 	func next() -> movedata {
-		var size = moves.size();
-		if (size == 0 || picked_moves++ == 20) return NONE_MOVE;
+		if (picked_moves == moves.size() || picked_moves == MAX_SEARCHED_MOVES) return NONE_MOVE;
 
-		var temp = moves[size - 1];
-		moves.pop_back();
-		return temp;
+		var best = picked_moves;
+		for (int i in range(picked_moves + 1, moves.size())) {
+			if (moves.scores[i] > moves.scores[best]) {
+				best = i;
+			}
+		}
 
+		moves.move_to(best, picked_moves);
+		return moves[picked_moves++];
 	}
 
 	func& random() {
 		var random = rand() % moves.size();
 		return moves[random];
 	}
+
+	// full move list, used by perft which must not be cut off at 20 moves
+	func begin() { return moves.begin(); }
+	func end()   { return moves.end(); }
+	func size()  { return moves.size(); }
 };
 
 
-func board::evaluate() -> int {
+// what the search keeps for every ply. one stack per thread, allocated on its
+// first search and reused for every search after that
+struct plydata {
+	movelist moves;
+	movedata move;
+	int reversible_plies;   // before move
+
+#ifdef ABALONE_COPY_MAKE
+	boardstate position;   // the position before move, restored instead of calling undo_move
+#endif
+};
+
+thread_local var search_stack = vector<plydata>(MAX_PLY);
+
+
+// everything but the captures, this is the part the eval cache keeps
+func board::piece_score() -> int {
 	func positional_score = lambda() {
 		var score = 0;
 		for (int x in range(9)) {
@@ -786,134 +1653,137 @@ func board::evaluate() -> int {
 		return score;
 	};
 
-	func captured_score = lambda() {
-		if (captured_white_pieces == 6) {
-			return  1000000;
-		}
-		if (captured_black_pieces == 6) {
-			return -1000000;
-		}
+	if (eval == NETWORK) {
+		return network->evaluate(features);
+	}
+	return positional_score() + neighbor_score();
+}
 
-		return 30 * (captured_black_pieces - captured_white_pieces);
-	};
+// the capture part of evaluate(), also used by the batch evaluation
+func capture_score(int captured_white_pieces, int captured_black_pieces) -> int {
+	if (captured_white_pieces == 6) {
+		return  1000000;
+	}
+	if (captured_black_pieces == 6) {
+		return -1000000;
+	}
+
+	return 30 * (captured_white_pieces - captured_black_pieces);
+}
+
+func board::captured_score() -> int {
+	return capture_score(captured_white_pieces, captured_black_pieces);
+}
+
+func board::evaluate() -> int {
+	return piece_score() + captured_score();
+}
 
-	return positional_score() + neighbor_score() + captured_score();
+// evaluate() through the eval cache. the cached part does not depend on the side to
+// move or the captures, so the piece placement and the evaluator are the whole key
+func board::evaluate_cached() -> int {
+	if (not eval_cache) {
+		return evaluate();
+	}
 
+	// the hash of the pieces alone, captures and side to move taken back out
+	var key = boardhash ^ BLACK_CAPTURED_RANDOMS[captured_black_pieces] ^ WHITE_CAPTURED_RANDOMS[captured_white_pieces];
+	key ^= (current_turn == WHITE ? WHITE_TO_MOVE_KEY : 0) ^ (eval == NETWORK ? NETWORK_EVAL_KEY : 0);
+	stats.eval_probes++;
+
+	var score = 0;
+	if (eval_cache->probe(key, score)) {
+		stats.eval_hits++;
+	}
+	else {
+		score = piece_score();
+		eval_cache->store(key, score);
+	}
+	return score + captured_score();
 }
 
 // does the given move. assumes the given move was legal
-func board::make_move(movedata& move) {
+func board::make_move(const movedata& move) {
 
-	let strait_move = (opposite(move.direction) == move.pulled_direction);
+	let strait_move = (opposite(move.direction()) == move.pulled_direction());
 	if (strait_move) {
-		// origin of the move
-		let origin_position = move.origin;
-		let origin_piece = pieces[origin_position];
-
 		// what position/piece is actually moved
-		let moved_position = move.origin - DIRS[move.direction] * move.pulled_neighbors;
+		let moved_position = move.origin() - DIRS[move.direction()] * move.pulled_neighbors();
 		let moved_piece = pieces[moved_position];
 
 		// what position/piece is moved to
-		let target_position = move.origin + DIRS[move.direction];
+		let target_position = move.origin() + DIRS[move.direction()];
 		let target_piece = pieces[target_position];
 		let target_empty = (target_piece.piececolor == 0);
 
 
 		if (target_empty) {
-
-			pieces[target_position] = moved_piece;
-			update_hash(target_position, move.piececolor);
-			dirty_neighbors(target_position);
-
-			dirty_neighbors(moved_position);
-			update_hash(moved_position, move.piececolor);
-			pieces[moved_position] = EMPTY_SPACE;
+			place_piece(target_position, moved_piece);
+			remove_piece(moved_position);
 		}
 
 		else /* target not empty */ {
 
-			let pushed_enemies = move.pushed_enemies;
-			let displace_position = move.origin + DIRS[move.direction] * (pushed_enemies + 1);
+			let pushed_enemies = move.pushed_enemies();
+			let displace_position = move.origin() + DIRS[move.direction()] * (pushed_enemies + 1);
 
 			let is_a_capture = not is_valid(displace_position);
 			if (is_a_capture) {
-				if (move.piececolor == WHITE) {
-					captured_black_pieces += 1;
-				}
-				if (move.piececolor == BLACK) {
-					captured_white_pieces += 1;
-				}
+				update_captured(opposite(move.piececolor()), 1);
 			}
 			else {
-				pieces[displace_position] = target_piece;
-				update_hash(displace_position, opposite(move.piececolor));
-				dirty_neighbors(displace_position);
+				place_piece(displace_position, target_piece);
 			}
 
-			dirty_neighbors(target_position);
-			update_hash(target_position, opposite(move.piececolor));
-			pieces[target_position] = moved_piece;
-			update_hash(target_position, move.piececolor);
-			dirty_neighbors(target_position);
-
-			dirty_neighbors(moved_position);
-			update_hash(moved_position, move.piececolor);
-			pieces[moved_position] = EMPTY_SPACE;
+			remove_piece(target_position);
+			place_piece(target_position, moved_piece);
+			remove_piece(moved_position);
 		}
 	}
 	else /* move is not strait */ {
-		for (int i in range(move.pulled_neighbors + 1)) {
-			let moved_position = move.origin + DIRS[move.pulled_direction] * i;
+		for (int i in range(move.pulled_neighbors() + 1)) {
+			let moved_position = move.origin() + DIRS[move.pulled_direction()] * i;
 			let moved_piece = pieces[moved_position];
 
-			let target_position = moved_position + DIRS[move.direction];
-
-			pieces[target_position] = moved_piece;
-			update_hash(target_position, move.piececolor);
-			dirty_neighbors(target_position);
+			let target_position = moved_position + DIRS[move.direction()];
 
-
-			dirty_neighbors(moved_position);
-			update_hash(moved_position, move.piececolor);
-			pieces[moved_position] = EMPTY_SPACE;
+			place_piece(target_position, moved_piece);
+			remove_piece(moved_position);
 		}
 	}
 
 	current_turn = opposite(current_turn);
+	boardhash ^= WHITE_TO_MOVE_KEY;
 
 }
 
 
-func board::undo_move(movedata move) {
+func board::undo_move(const movedata& move) {
+
+	let piececolor = move.piececolor();
+	let origin = move.origin();
+	let direction = move.direction();
+	let pulled_neighbors = move.pulled_neighbors();
+	let pulled_direction = move.pulled_direction();
+	let pushed_enemies = move.pushed_enemies();
+	let captured_enemy = move.captured_enemy();
 
-	let strait_move = (opposite(move.direction) == move.pulled_direction);
+	let strait_move = (opposite(direction) == pulled_direction);
 	if (strait_move) {
 
-		let no_push_move = (move.pushed_enemies == 0);
-		let single_push_and_capture = (move.pushed_enemies == 1 && move.captured_enemy);
+		let no_push_move = (pushed_enemies == 0);
+		let single_push_and_capture = (pushed_enemies == 1 && captured_enemy);
 		if (no_push_move || single_push_and_capture) {
-			var reverse_move = move;
-
-			reverse_move.direction = move.pulled_direction;
-			reverse_move.pulled_direction = move.direction;
-
-			reverse_move.origin = move.origin + DIRS[move.direction] * (1 - move.pulled_neighbors);
-
+			let reverse_origin = origin + DIRS[direction] * (1 - pulled_neighbors);
+			let reverse_move = movedata(piececolor, reverse_origin, pulled_direction, pulled_neighbors, direction, pushed_enemies, captured_enemy);
 
 			make_move(reverse_move);
 
-			if (move.captured_enemy) {
-				let retured_position = move.origin + DIRS[move.direction];
+			if (captured_enemy) {
+				let retured_position = origin + DIRS[direction];
 
-				if (move.piececolor == WHITE) {
-					captured_black_pieces -= 1;
-					pieces[retured_position] = BLACK_PIECE;
-				}
-				if (move.piececolor == BLACK) {
-					captured_white_pieces -= 1;
-					pieces[retured_position] = WHITE_PIECE;
-				}
+				update_captured(opposite(piececolor), -1);
+				place_piece(retured_position, piececolor == WHITE ? BLACK_PIECE : WHITE_PIECE);
 
 			}
 
@@ -921,32 +1791,17 @@ func board::undo_move(movedata move) {
 
 		}
 		else /* was a pushing move */ {
-			var reverse_move = move;
-
-			reverse_move.direction = move.pulled_direction;
-			reverse_move.pulled_direction = move.direction;
-
-			reverse_move.origin = move.origin + DIRS[move.direction] * 2;
-
-			reverse_move.pulled_neighbors = move.pushed_enemies - 1 - move.captured_enemy;
-			reverse_move.pushed_enemies = move.pulled_neighbors + 1;
-
-			reverse_move.piececolor = opposite(move.piececolor);
-
+			let reverse_origin = origin + DIRS[direction] * 2;
+			let reverse_pulled = pushed_enemies - 1 - captured_enemy;
+			let reverse_move = movedata(opposite(piececolor), reverse_origin, pulled_direction, reverse_pulled, direction, pulled_neighbors + 1, captured_enemy);
 
 			make_move(reverse_move);
 
-			if (move.captured_enemy) {
-				let retured_position = move.origin + DIRS[move.direction] * (move.pushed_enemies);
+			if (captured_enemy) {
+				let retured_position = origin + DIRS[direction] * (pushed_enemies);
 
-				if (move.piececolor == WHITE) {
-					captured_black_pieces -= 1;
-					pieces[retured_position] = BLACK_PIECE;
-				}
-				if (move.piececolor == BLACK) {
-					captured_white_pieces -= 1;
-					pieces[retured_position] = WHITE_PIECE;
-				}
+				update_captured(opposite(piececolor), -1);
+				place_piece(retured_position, piececolor == WHITE ? BLACK_PIECE : WHITE_PIECE);
 
 			}
 
@@ -956,10 +1811,8 @@ func board::undo_move(movedata move) {
 
 	}
 	else /* was a broadside move */ {
-		var reverse_move = move;
-		reverse_move.origin = move.origin + DIRS[move.direction];
-		reverse_move.direction = opposite(move.direction);
-
+		let reverse_origin = origin + DIRS[direction];
+		let reverse_move = movedata(piececolor, reverse_origin, opposite(direction), pulled_neighbors, pulled_direction, pushed_enemies, captured_enemy);
 
 		make_move(reverse_move);
 		return;
@@ -967,115 +1820,2919 @@ func board::undo_move(movedata move) {
 
 }
 
-// simple minimax with alpha beta pruning
-func board::search(int alpha, int beta, int depthleft) -> int {
+// with ABALONE_COPY_MAKE defined the position is copied before every move and
+// copied back afterwards, otherwise the move is reversed by undo_move
+func board::push_move(const movedata& move, plydata& frame) -> void {
+#ifdef ABALONE_COPY_MAKE
+	frame.position = *this;
+#endif
+	key_history.push_back(boardhash);
+	frame.reversible_plies = reversible_plies;
+	reversible_plies = move.captured_enemy() ? 0 : reversible_plies + 1;
+	make_move(move);
+}
 
-	if (depthleft == 0) {
-		return evaluate();
-	}
+func board::pop_move(const movedata& move, plydata& frame) -> void {
+#ifdef ABALONE_COPY_MAKE
+	static_cast<boardstate&>(*this) = frame.position;
+#else
+	undo_move(move);
+#endif
+	key_history.pop_back();
+	reversible_plies = frame.reversible_plies;
+}
 
-	var score = 0;
-	var move = movedata();
-	var movepick = movegen(this);
+// a move of the game, it stays in key_history for the searches after it
+func board::play_move(const movedata& move) -> void {
+	key_history.push_back(boardhash);
+	reversible_plies = move.captured_enemy() ? 0 : reversible_plies + 1;
+	make_move(move);
+}
 
-	while ((move = movepick.next()).is_valid()) {
+// room for a search below the game's keys. the capacity doubles, so a long game only reallocates a few times
+func board::reserve_history() -> void {
+	if (key_history.capacity() - key_history.size() < size_t(MAX_PLY)) {
+		key_history.reserve(2 * key_history.size() + MAX_PLY);
+	}
+}
+
+// the key_history index of an earlier occurrence of this position, -1 if there is none.
+// only the plies since the last capture are scanned, and of those every second one, the
+// ones with the same side to move. a position comes back after 4 plies at the earliest
+func board::find_repetition() -> int {
+	let size = int(key_history.size());
+	for (int i = size - 4; i >= size - reversible_plies; i -= 2) {
+		if (key_history[i] == boardhash) return i;
+	}
+	return -1;
+}
 
-		make_move(move);
+// whether a draw found below this node repeated a position from before it
+func board::path_dependent() -> bool {
+	return repetition_index < int(key_history.size());
+}
 
-		if (position_is_transposition()) {
-			score = transposition_value();
-		}
-		else /*first time position is searched */ {
-			score = -search(-beta, -alpha, depthleft - 1);
-		}
+// how often this position was on the board before
+func board::count_repetitions() -> int {
+	let size = int(key_history.size());
+	var count = 0;
+	for (int i = size - 4; i >= size - reversible_plies; i -= 2) {
+		count += key_history[i] == boardhash;
+	}
+	return count;
+}
 
-		undo_move(move);
+func board::should_stop() -> bool {
+	return (stop && stop->load(memory_order_relaxed)) || chrono::steady_clock::now() >= deadline;
+}
 
+//////////
+// PROBCUT
+// most nodes of a fixed depth search only prove that a clearly bad line is bad. a node
+// that fails high or low by far usually shows it in a much shallower search already: if
+// the shallow score predicts the deep one beyond the window by PROBCUT_THRESHOLD sigmas,
+// the node returns the bound without the deep search. a null window search at the
+// predicted bound is enough to check that. the fits come from the calibrate tool
+// and are loaded with --probcut=<file>
+
+let PROBCUT_MIN_DEPTH = 4;        // below, the deep search is not much more than the shallow one
+let PROBCUT_REDUCTION = 2;        // even, so both searches end with the same side to move
+let PROBCUT_THRESHOLD = 1.5;      // in sigmas, more prunes less and is wrong less often
+let PROBCUT_MAX_SCORE = 500000;   // a bound beyond is about a won game, the fits are not
+let PROBCUT_MIN_SLOPE = 0.1;      // a flatter fit predicts nothing, and its bounds would not fit an int
+let PROBCUT_MAGIC = string("abalone probcut 1");
+
+// the magic line, then one line per depth: depth shallow a b sigma
+func probcutmodel::load(string path) -> bool {
+	var file = ifstream(path);
+	var magic = string();
+	if (not getline(file, magic) || magic != PROBCUT_MAGIC) {
+		return false;
+	}
 
-		// beta cutoff
-		if (score > beta) {
-			return beta;
+	var depth = 0;
+	var fit = probcutfit();
+	while (file >> depth >> fit.shallow >> fit.a >> fit.b >> fit.sigma) {
+		if (depth < 1 || depth >= MAX_PLY || fit.shallow < 1 || fit.shallow >= depth) {
+			return false;
 		}
-		// alpha improvement
-		if (score > alpha) {
-			alpha = score;
+		if (not (fit.a >= PROBCUT_MIN_SLOPE && isfinite(fit.a) && isfinite(fit.b) && fit.sigma >= 0 && isfinite(fit.sigma))) {
+			return false;
 		}
+		fits[depth] = fit;
 	}
-
-	add_to_transposition_table(alpha);
-	return alpha;
+	return file.eof();
 }
 
-
-// simple minimax for the root move
-func board::find_best(int maxdepth) -> movedata {
-
-	var move = movedata();
-	var bestmove = movedata();
-	var movepick = movegen(this);
-	var bestscore = INT_MIN;
-
-	while ((move = movepick.next()).is_valid()) {
-
-		make_move(move);
-
-		var score = -search(INT_MAX, INT_MAX, maxdepth - 1);
-
-		if (bestscore < score) {
-			bestscore = score;
-			bestmove = move;
+func probcutmodel::save(string path) const -> bool {
+	var file = ofstream(path);
+	file << PROBCUT_MAGIC << "\n" << setprecision(6);
+	for (int depth in range(MAX_PLY)) {
+		let& fit = fits[depth];
+		if (fit.shallow > 0) {
+			file << depth << " " << fit.shallow << " " << fit.a << " " << fit.b << " " << fit.sigma << "\n";
 		}
-
-		undo_move(move);
 	}
+	return bool(file);
+}
 
-	return bestmove;
+func load_probcut(string path) -> bool {
+	var model = make_unique<probcutmodel>();
+	if (not model->load(path)) {
+		cerr << "could not read probcut parameters from " << path << "\n";
+		return false;
+	}
+	probcut_model = move(model);
+	return true;
 }
 
+// whether the shallow search predicts that this node fails high or low, score is then
+// the bound. the shallow searches run on this node's ply, before its moves are generated
+func board::probcut_prune(int alpha, int beta, int depthleft, int ply, int& score) -> bool {
+	let& fit = probcut_model->fits[depthleft];
+	if (fit.shallow == 0) {
+		return false;
+	}
 
-func board::find_random() -> movedata {
-	var movepick = movegen(this);
-	var random_move = movepick.random();
-	return random_move;
-}
+	let outer_repetition = repetition_index;
+	let margin = PROBCUT_THRESHOLD * fit.sigma;
+	func shallow_bound = lambda(double score) {
+		return int(clamp(score, double(-INFINITE_SCORE), double(INFINITE_SCORE)));
+	};
 
-func board::find_best_or_random() -> movedata {
-	if (current_turn == WHITE) {
-		return find_random();
+	// a * shallow + b >= beta + margin
+	if (beta < PROBCUT_MAX_SCORE) {
+		let bound = shallow_bound(ceil((beta + margin - fit.b) / fit.a));
+		if (search(bound - 1, bound, fit.shallow, ply) >= bound && not aborted) {
+			score = beta;
+			return true;
+		}
 	}
-	if (current_turn == BLACK) {
-		return find_best(5);
+	// a * shallow + b <= alpha - margin
+	if (alpha > -PROBCUT_MAX_SCORE && not aborted) {
+		let bound = shallow_bound(floor((alpha - margin - fit.b) / fit.a));
+		if (search(bound, bound + 1, fit.shallow, ply) <= bound && not aborted) {
+			score = alpha;
+			return true;
+		}
 	}
+
+	// no prediction, the draws the shallow searches ran into do not decide this node
+	repetition_index = outer_repetition;
+	return false;
 }
 
 
+// simple minimax with alpha beta pruning. scores are from the side to move
+func board::search(int alpha, int beta, int depthleft, int ply) -> int {
 
+	stats.nodes++;
 
-func main() -> int {
+#ifdef ABALONE_VERIFY_HASH
+	verify_hash();
+#endif
 
-	var board = parse_to_board(STARTING_BOARD);
+	if ((stats.nodes & 1023) == 0 && should_stop()) {
+		aborted = true;
+	}
+	if (split && split->cancelled()) {
+		aborted = true;
+	}
+	if (aborted) {
+		return 0;
+	}
 
-	for (int i in range(100)) {
+	let repeated = find_repetition();
+	if (repeated >= 0) {
+		repetition_index = min(repetition_index, repeated);
+		return DRAW_SCORE;
+	}
 
-		// Black players turn. My AI
-		var move = board.find_best(5);
-		print("After Blacks turn: \n ");
-		board.make_move(move);
-		board.print_board();
-		print(""); print("");
+	if (depthleft == 0 || ply == MAX_PLY - 1 || black_won() || white_won()) {
+		return evaluate_cached() * current_turn;
+	}
 
-		if (board.black_won()) {
-			print("Black Wins");
-			return 0;
+	// the stored score is good enough if it was searched at least as deep and its bound fits the window.
+	// a deeper score depends on which thread stored it first, so a reproducible search takes only the same depth
+	let entry = transposition_table->probe(boardhash);
+	let deep_enough = reproducible ? entry.depth == depthleft : entry.depth >= depthleft;
+	if (entry.kind != NO_BOUND && deep_enough) {
+		if (entry.kind == EXACT) {
+			return clamp(entry.score, alpha, beta);
 		}
+		if (entry.kind == LOWER && entry.score >= beta) {
+			return beta;
+		}
+		if (entry.kind == UPPER && entry.score <= alpha) {
+			return alpha;
+		}
+	}
+
+	// a score that depends on a repetition of a position before this node depends on the
+	// path to it, it is not stored. the index is passed up to the parent on every return
+	let outer_repetition = repetition_index;
+	repetition_index = NO_REPETITION;
+	func leave = lambda(int score) {
+		repetition_index = min(repetition_index, outer_repetition);
+		return score;
+	};
+
+	// a node predicted far outside the window is not searched, it is not stored either
+	if (probcut && depthleft >= PROBCUT_MIN_DEPTH) {
+		var predicted = 0;
+		if (probcut_prune(alpha, beta, depthleft, ply, predicted)) {
+			return leave(predicted);
+		}
+		if (aborted) {
+			return 0;
+		}
+	}
+
+	let original_alpha = alpha;
+	var score = 0;
+	var& frame = search_stack[ply];
+	var& move = frame.move;
+	var bestmove = NONE_MOVE;
+
+	// the move orders too, and with the 20 move cap it decides which moves are searched at all
+	let hashmove = not reproducible || entry.depth == depthleft ? entry.move : uint16_t(0);
+	var movepick = movegen(this, frame.moves, hashmove);
+
+	while ((move = movepick.next()).is_valid()) {
+
+		push_move(move, frame);
+		score = -search(-beta, -alpha, depthleft - 1, ply + 1);
+		pop_move(move, frame);
+
+		if (aborted) {
+			return 0;
+		}
+
+		// beta cutoff
+		if (score >= beta) {
+			if (not path_dependent()) add_to_transposition_table(beta, LOWER, depthleft, move);
+			return leave(beta);
+		}
+		// alpha improvement
+		if (score > alpha) {
+			alpha = score;
+			bestmove = move;
+		}
+
+		// young brothers wait: once the eldest child is searched, the others may go in parallel
+		if (pool && depthleft >= SPLIT_DEPTH && pool->has_idle()) {
+			return leave(split_search(alpha, beta, depthleft, ply, movepick, bestmove, original_alpha));
+		}
+	}
+
+	if (not path_dependent()) add_to_transposition_table(alpha, alpha > original_alpha ? EXACT : UPPER, depthleft, bestmove);
+	return leave(alpha);
+}
+
+
+// the rest of the moves of a node in parallel. returns what search would have
+func board::split_search(int alpha, int beta, int depthleft, int ply, movegen& movepick, movedata bestmove, int original_alpha) -> int {
+	var point = splitpoint();
+	point.position = *this;
+	point.owner = this;
+	point.parent = split;
+	point.beta = beta;
+	point.depthleft = depthleft;
+	point.ply = ply;
+	point.alpha = alpha;
+	point.bestmove = bestmove;
+	point.history_size = int(key_history.size());
+	point.reversible_plies = reversible_plies;
+	point.repetition_index = repetition_index;
+	for (var move = movepick.next(); move.is_valid(); move = movepick.next()) {
+		point.moves[point.count++] = move;
+	}
+
+	pool->publish(&point);
+	work_on(point);
+	pool->retract(&point);
+	pool->wait_for_helpers(*this, point);
+
+	// a cutoff here stopped this thread's own move too, that is not an abort
+	aborted = (split && split->cancelled()) || should_stop();
+	if (aborted) {
+		return 0;
+	}
+
+	repetition_index = point.repetition_index;
+	if (point.cutoff) {
+		if (not path_dependent()) add_to_transposition_table(beta, LOWER, depthleft, point.bestmove);
+		return beta;
+	}
+
+	if (not path_dependent()) add_to_transposition_table(point.alpha, point.alpha > original_alpha ? EXACT : UPPER, depthleft, point.bestmove);
+	return point.alpha;
+}
+
+// takes moves from the split point until there are none left or it is cut off.
+// the first shared_history keys of this board are already the owner's
+func board::work_on(splitpoint& point, int shared_history) -> void {
+	let outer = split;
+	split = &point;
+
+	if (point.owner != this) {
+		static_cast<boardstate&>(*this) = point.position;
+		// the owner only writes above history_size while the split point is open. an owner
+		// helping below its own split point keeps its keys up to there, other helpers may be
+		// copying them for that split point
+		key_history.resize(shared_history);
+		key_history.insert(key_history.end(), point.owner->key_history.begin() + shared_history, point.owner->key_history.begin() + point.history_size);
+		reversible_plies = point.reversible_plies;
+		deadline = point.owner->deadline;
+		stop = point.owner->stop;
+		eval = point.owner->eval;
+		probcut = point.owner->probcut;
+		reproducible = point.owner->reproducible;
+	}
+
+	var& frame = search_stack[point.ply];
+	for (var i = point.next++; i < point.count; i = point.next++) {
+		let move = point.moves[i];
+		frame.move = move;
+
+		repetition_index = NO_REPETITION;
+		push_move(move, frame);
+		let score = -search(-point.beta, -point.alpha.load(), point.depthleft - 1, point.ply + 1);
+		pop_move(move, frame);
+
+		if (aborted) {
+			break;
+		}
+
+		var guard = lock_guard(point.lock);
+		point.repetition_index = min(point.repetition_index, repetition_index);
+		if (score >= point.beta) {
+			point.bestmove = move;
+			point.cutoff = true;
+			break;
+		}
+		if (score > point.alpha) {
+			point.alpha = score;
+			point.bestmove = move;
+		}
+	}
+
+	split = outer;
+}
+
+
+
+//////////////////////
+// TIME MANAGEMENT
+// with a game clock instead of a time per move, find_best asks the time manager after
+// every iteration whether to start the next one. a move gets more time while the best
+// move changes or the score swings, and less once it has been stable a few iterations,
+// with few legal moves, or with only one
+
+let MOVES_TO_GO = 30;           // the clock is shared out as if this many moves were left
+let MAX_CLOCK_SHARE = 0.2;      // no move takes more of what is left
+let SWING_SCALE = 30;           // a score change of a captured piece doubles the time
+let TYPICAL_LEGAL_MOVES = 40;
+
+struct timemanager {
+	double base_ms = 0;         // the even share of the clock
+	double hard_ms = 0;         // never more than this
+	double target_ms = 0;       // what this move should take, the deadline of the next iteration
+	int legal_moves = 0;
+
+	movedata last_best;
+	array<int, 2> scores = { 0, 0 };   // of the last two iterations, odd and even depths score differently
+	int iterations = 0;
+	int stable_iterations = 0;
+	double last_elapsed_ms = 0;
+	double last_iteration_ms = 0;
+	double growth = 4;          // how much longer an iteration takes than the one before
+
+	init timemanager() = default;
+	init timemanager(chrono::milliseconds clock, int legal_moves) : legal_moves(legal_moves) {
+		base_ms = double(clock.count()) / MOVES_TO_GO;
+		hard_ms = min(clock.count() * MAX_CLOCK_SHARE, base_ms * 4);
+		target_ms = min(base_ms, hard_ms);
+	}
+
+	// after an iteration finished, elapsed_ms after the start of the search
+	func next_iteration(movedata best, int score, double elapsed_ms) -> bool {
+		let iteration_ms = elapsed_ms - last_elapsed_ms;
+		if (last_iteration_ms > 0.1) growth = clamp(iteration_ms / last_iteration_ms, 2.0, 10.0);
+
+		let first = not last_best.is_valid();
+		stable_iterations = not first && best.id() == last_best.id() ? stable_iterations + 1 : 0;
+
+		// the swing is against the iteration before the last, which has the same side at the leaves
+		var scale = 1.0;
+		if (not first) {
+			if (stable_iterations == 0) scale *= 1.6;
+			if (stable_iterations >= 3) scale *= 0.6;
+		}
+		if (iterations >= 2) {
+			scale *= 1 + min(abs(score - scores[iterations % 2]) / double(SWING_SCALE), 1.0);
+		}
+		scale *= clamp(legal_moves / double(TYPICAL_LEGAL_MOVES), 0.5, 1.25);
+
+		last_best = best;
+		scores[iterations++ % 2] = score;
+		last_elapsed_ms = elapsed_ms;
+		last_iteration_ms = iteration_ms;
+
+		if (legal_moves <= 1) return false;
+
+		// an iteration cut off at the target still counts when it found a move, so one is
+		// started while less than half the target is used, even if it cannot finish
+		target_ms = min(base_ms * scale, hard_ms);
+		return elapsed_ms + iteration_ms * growth <= target_ms || elapsed_ms < target_ms / 2;
+	}
+};
+
+
+// alpha beta for the root move, returns the score and sets bestmove
+func board::search_root(int depth, movedata& bestmove) -> int {
+	allocate_tables();
+	reserve_history();
+	repetition_index = NO_REPETITION;
+
+	let entry = transposition_table->probe(boardhash);
+
+	var& frame = search_stack[0];
+	var& move = frame.move;
+	var movepick = movegen(this, frame.moves, entry.move);
+	var alpha = -INFINITE_SCORE;
+
+	while ((move = movepick.next()).is_valid()) {
+
+		push_move(move, frame);
+		var score = -search(-INFINITE_SCORE, -alpha, depth - 1, 1);
+		pop_move(move, frame);
+
+		if (aborted) {
+			break;
+		}
+
+		if (score > alpha) {
+			alpha = score;
+			bestmove = move;
+		}
+	}
+
+	// a score that depends on the game's earlier positions only keeps its move, at a depth no search trusts
+	if (not aborted) {
+		add_to_transposition_table(alpha, EXACT, path_dependent() ? 0 : depth, bestmove);
+	}
+	return alpha;
+}
+
+
+// fixed depth search for the root move
+func board::find_best(int maxdepth) -> movedata {
+	var bestmove = movedata();
+	aborted = false;
+	search_root(maxdepth, bestmove);
+	return bestmove;
+}
+
+
+// iterative deepening until the depth or time limit. a cut off iteration only counts
+// if it already found a move, the moves it did not get to are the worse ones by ordering
+func board::find_best(searchlimits limits) -> movedata {
+	let start = chrono::steady_clock::now();
+	deadline = limits.time.count() > 0 ? start + limits.time : chrono::steady_clock::time_point::max();
+	stop = limits.stop;
+	aborted = false;
+
+	let managed = limits.clock.count() > 0;
+	var manager = timemanager();
+	if (managed) {
+		var list = movelist();
+		manager = timemanager(limits.clock, movegen(this, list).size());
+		deadline = start + chrono::microseconds(int64_t(manager.target_ms * 1000));
+	}
+
+	// more threads split the search, the helpers only live for this search and share the tables
+	allocate_tables();
+	var helpers = unique_ptr<splitpool>();
+	let was_reproducible = reproducible;
+	if (limits.threads > 1) {
+		helpers = make_unique<splitpool>(*this, limits.threads - 1);
+		pool = helpers.get();
+		reproducible = true;
+	}
+
+	var bestmove = movedata();
+	for (int depth in range(1, limits.depth + 1)) {
+		var iteration_best = movedata();
+		let score = search_root(depth, iteration_best);
+
+		if (iteration_best.is_valid()) {
+			bestmove = iteration_best;
+		}
+		if (aborted || should_stop()) {
+			break;
+		}
+		if (managed) {
+			if (not manager.next_iteration(iteration_best, score, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count())) break;
+			deadline = start + chrono::microseconds(int64_t(manager.target_ms * 1000));
+		}
+	}
+
+	if (helpers) {
+		stats.nodes += helpers->nodes;
+		helpers.reset();
+		pool = nullptr;
+		reproducible = was_reproducible;
+	}
+
+	deadline = chrono::steady_clock::time_point::max();
+	stop = nullptr;
+	aborted = false;
+
+	return bestmove.is_valid() ? bestmove : find_random();
+}
+
+
+// every root move is searched with alpha at the score of the k-th best line so far,
+// so the k best come back with exact scores and the rest fail low as cheap as
+// in a single pv search. lines is sorted best first on return
+func board::search_lines(int depth, vector<rootline>& lines, int k) -> void {
+	allocate_tables();
+	reserve_history();
+	repetition_index = NO_REPETITION;
+
+	var& frame = search_stack[0];
+	var best = vector<int>();   // exact scores found so far, best first, at most k
+	best.reserve(k + 1);
+
+	for (var& line in lines) {
+		let alpha = int(best.size()) < k ? -INFINITE_SCORE : best.back();
+
+		frame.move = line.move;
+		push_move(line.move, frame);
+		let score = -search(-INFINITE_SCORE, -alpha, depth - 1, 1);
+		pop_move(line.move, frame);
+
+		if (aborted) {
+			return;
+		}
+
+		line.score = score;
+		line.exact = score > alpha;
+		if (line.exact) {
+			best.insert(upper_bound(best.begin(), best.end(), score, greater<int>()), score);
+			if (int(best.size()) > k) best.pop_back();
+		}
+	}
+
+	stable_sort(lines.begin(), lines.end(), lambda(const rootline& a, const rootline& b) {
+		return a.score != b.score ? a.score > b.score : a.exact > b.exact;
+	});
+	add_to_transposition_table(lines.front().score, EXACT, path_dependent() ? 0 : depth, lines.front().move);
+}
+
+
+// follows the transposition table from the position after first. stops at the
+// first entry that is not exact, so a line may be shorter than the search depth
+func board::principal_variation(movedata first, int depth) -> vector<movedata> {
+	var line = vector<movedata>{ first };
+	var b = *this;
+	b.make_move(first);
+
+	while (int(line.size()) < depth && not b.black_won() && not b.white_won()) {
+		let entry = transposition_table->probe(b.boardhash);
+		if (entry.kind != EXACT) break;
+
+		let move = b.legal_move(entry.move);
+		if (not move.is_valid()) break;
+
+		line.push_back(move);
+		b.make_move(move);
+	}
+	return line;
+}
+
+
+// iterative deepening like find_best, but returns the k best root moves with their
+// scores and principal variations. each iteration orders the root moves by the last one
+func board::find_best_lines(searchlimits limits, int k) -> vector<rootline> {
+	allocate_tables();
+	deadline = limits.time.count() > 0 ? chrono::steady_clock::now() + limits.time : chrono::steady_clock::time_point::max();
+	stop = limits.stop;
+	aborted = false;
+
+	// the same root moves, in the same first order, as search_root
+	var lines = vector<rootline>();
+	var movepick = movegen(this, search_stack[0].moves, transposition_table->probe(boardhash).move);
+	for (var move = movepick.next(); move.is_valid(); move = movepick.next()) {
+		lines.push_back(rootline{ move });
+	}
+
+	var result = vector<rootline>();
+	var completed = 0;
+	for (int depth in range(1, limits.depth + 1)) {
+		if (lines.empty()) break;
+
+		var iteration = lines;
+		search_lines(depth, iteration, k);
+		if (aborted) break;
+
+		lines = iteration;
+		completed = depth;
+		if (should_stop()) break;
+	}
+
+	for (var& line in lines) {
+		if (int(result.size()) == k || not line.exact) break;
+		line.pv = principal_variation(line.move, completed);
+		result.push_back(line);
+	}
+
+	deadline = chrono::steady_clock::time_point::max();
+	stop = nullptr;
+	aborted = false;
+
+	return result;
+}
+
+
+func board::find_random() -> movedata {
+	var list = movelist();
+	var movepick = movegen(this, list);
+	var random_move = movepick.random();
+	return random_move;
+}
+
+// the full move for a movedata::id(), for example from the transposition table.
+// NONE_MOVE if it is not legal here
+func board::legal_move(uint16_t id) -> movedata {
+	var list = movelist();
+	for (var move in movegen(this, list)) {
+		if (move.id() == id) return move;
+	}
+	return NONE_MOVE;
+}
+
+func board::find_best_or_random() -> movedata {
+	if (current_turn == WHITE) {
+		return find_random();
+	}
+	return find_best(5);
+}
+
+
+
+
+////////////////////
+// BATCH EVALUATION
+// the handcrafted evaluate() for many independent positions at once, for tuning, book
+// building and analysis. the positions are stored as planes, one row per cell holding
+// that cell's color in every position, so each step of the evaluation is the same
+// operation along a row: 32 positions per AVX2 instruction. the scalar fallback has the
+// same shape, which the compiler can vectorize with whatever the target has
+
+let BATCH_LANES = 32;
+
+// the 61 cells of the board
+constexpr let BOARD_CELLS = [] {
+	array<int8_t, 61> cells{};
+	var count = 0;
+	for (int cell = 0; cell < CELLS; cell++) {
+		if (valid_cell(cell / 9, cell % 9)) cells[count++] = int8_t(cell);
+	}
+	return cells;
+}();
+
+// SCORE_MAP by cell index
+constexpr let CELL_SCORES = [] {
+	array<int8_t, CELLS> scores{};
+	for (int cell = 0; cell < CELLS; cell++) {
+		scores[cell] = int8_t(SCORE_MAP[cell / 9][cell % 9]);
+	}
+	return scores;
+}();
+
+struct positionbatch {
+	int count = 0;
+	int stride = 0;                  // count rounded up to BATCH_LANES, the padding holds empty boards
+	vector<int8_t> planes;           // planes[cell * stride + i] is the color of cell in position i, OFF_BOARD included
+	vector<int8_t> captured_white;
+	vector<int8_t> captured_black;
+
+	init positionbatch(int count);
+
+	func set(int i, const boardstate& position) -> void;
+
+	// scores[i] is what evaluate() with the handcrafted evaluation returns for position i
+	func evaluate(vector<int>& scores) const -> void;
+};
+
+positionbatch::positionbatch(int count) : count(count), stride((count + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES),
+	planes((CELLS + 1) * stride, EMPTY), captured_white(count), captured_black(count) {
+	fill(planes.begin() + OFF_BOARD * stride, planes.end(), OUTSIDE);
+}
+
+func positionbatch::set(int i, const boardstate& position) -> void {
+	for (var cell in BOARD_CELLS) {
+		planes[cell * stride + i] = position.pieces.cell(cell).piececolor;
+	}
+	captured_white[i] = int8_t(position.captured_white_pieces);
+	captured_black[i] = int8_t(position.captured_black_pieces);
+}
+
+// per cell: (SCORE_MAP + the same colored neighbors counted like get_neighbor) * color.
+// the colors are -1, 0 and 1, so the sum of one cell fits in int8 and the product is a sign
+// change. OUTSIDE on OFF_BOARD never equals a color, like in get_neighbor
+func positionbatch::evaluate(vector<int>& scores) const -> void {
+	scores.resize(count);
+	alignas(32) array<int16_t, BATCH_LANES> piece_scores;
+
+	for (int first = 0; first < count; first += BATCH_LANES) {
+#ifdef __AVX2__
+		func row = lambda(int cell) {
+			return _mm256_loadu_si256((const __m256i*)&planes[cell * stride + first]);
+		};
+
+		var low = _mm256_setzero_si256();
+		var high = _mm256_setzero_si256();
+		for (var cell in BOARD_CELLS) {
+			let own = row(cell);
+			var term = _mm256_set1_epi8(CELL_SCORES[cell]);
+			for (var dir in dirs) {
+				let& ray = RAYS[cell][dir];
+				let first_same = _mm256_cmpeq_epi8(row(ray[1]), own);   // -1 where equal
+				let both_same = _mm256_and_si256(first_same, _mm256_cmpeq_epi8(row(ray[2]), own));
+				term = _mm256_sub_epi8(_mm256_sub_epi8(term, first_same), both_same);
+			}
+			term = _mm256_sign_epi8(term, own);
+
+			low = _mm256_add_epi16(low, _mm256_cvtepi8_epi16(_mm256_castsi256_si128(term)));
+			high = _mm256_add_epi16(high, _mm256_cvtepi8_epi16(_mm256_extracti128_si256(term, 1)));
+		}
+		_mm256_store_si256((__m256i*)&piece_scores[0], low);
+		_mm256_store_si256((__m256i*)&piece_scores[16], high);
+#else
+		piece_scores.fill(0);
+		for (var cell in BOARD_CELLS) {
+			let own = &planes[cell * stride + first];
+			var term = array<int8_t, BATCH_LANES>();
+			term.fill(CELL_SCORES[cell]);
+			for (var dir in dirs) {
+				let near = &planes[RAYS[cell][dir][1] * stride + first];
+				let far = &planes[RAYS[cell][dir][2] * stride + first];
+				for (int i in range(BATCH_LANES)) {
+					let first_same = int8_t(near[i] == own[i]);
+					term[i] += first_same + (first_same & int8_t(far[i] == own[i]));
+				}
+			}
+			for (int i in range(BATCH_LANES)) {
+				piece_scores[i] += own[i] * term[i];
+			}
+		}
+#endif
+
+		for (int i = first; i < min(first + BATCH_LANES, count); i++) {
+			scores[i] = piece_scores[i - first] + capture_score(captured_white[i], captured_black[i]);
+		}
+	}
+}
+
+
+
+
+///////////////////////////
+// MONTE CARLO TREE SEARCH
+// the alternative engine. PUCT with the move ordering scores as priors, light
+// rollouts, tree parallel with virtual loss and the tree kept between moves
+
+let MCTS_EXPLORATION = 1.5f;
+let MCTS_PRIOR_TEMPERATURE = 20.0f;
+let MCTS_EXPAND_VISITS = 2;         // a leaf is expanded once it was visited this often
+let MCTS_ROLLOUT_PLIES = 40;
+let MCTS_ROLLOUT_SCALE = 40.0f;     // evaluation difference that is worth ~73% at the end of a rollout
+let MCTS_MAX_NODES = 1 << 21;       // per pool, a tree has two
+let MCTS_MIN_NODES = 1 << 16;
+let MCTS_NODES_PER_MS = 1000.0;     // a thread adds about 250, the rest is room for the reused part
+
+enum expansion {
+	LEAF = 0,
+	EXPANDING = 1,
+	EXPANDED = 2,
+};
+
+struct mctsnode {
+	movedata move;                  // the move leading here
+	float prior = 0;
+	int first_child = 0;            // children are a contiguous block in the pool
+	int child_count = 0;
+
+	atomic<int> state = LEAF;
+	atomic<int> visits = 0;
+	atomic<int> virtual_loss = 0;   // threads currently below this node
+	atomic<float> value = 0;        // summed results for the player who made move, at the root for the side not to move
+};
+
+// nodes never move and are never freed one by one, the pool is reset or compacted as a whole
+struct mctspool {
+	vector<mctsnode> nodes;
+	atomic<int> used = 0;
+
+	init mctspool(int capacity) : nodes(capacity) {}
+
+	// returns the first index of count fresh nodes, or -1 if the pool is full. a failed
+	// allocation leaves used alone, so it cannot make the allocations of other threads fail
+	func allocate(int count) -> int {
+		var first = used.load();
+		do {
+			if (first + count > int(nodes.size())) return -1;
+		} while (not used.compare_exchange_weak(first, first + count));
+		return first;
+	}
+};
+
+// small per thread generator, rand() is shared state
+thread_local uint64_t random_state = hash<thread::id>()(this_thread::get_id()) | 1;
+
+func fast_random() -> uint64_t {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return random_state;
+}
+
+func same_position(const boardstate& a, const boardstate& b) -> bool {
+	if (a.current_turn != b.current_turn || a.captured_black_pieces != b.captured_black_pieces || a.captured_white_pieces != b.captured_white_pieces) {
+		return false;
+	}
+	for (int x in range(9)) {
+		for (int y in range(9)) {
+			if (a.pieces.cell(x * 9 + y).piececolor != b.pieces.cell(x * 9 + y).piececolor) return false;
+		}
+	}
+	return true;
+}
+
+
+class mcts {
+private:
+	int capacity;                   // nodes per pool
+	unique_ptr<mctspool> pool;      // both allocated by the first search
+	unique_ptr<mctspool> spare;     // compaction target when the tree is reused
+	board root_position;
+	bool has_tree = false;
+
+	chrono::steady_clock::time_point deadline;
+	const atomic<bool>* stop = nullptr;
+
+public:
+	uint64_t playouts = 0;          // of the last find_best
+	int reused_nodes = 0;           // of the last find_best
+
+	init mcts(int capacity = MCTS_MAX_NODES) : capacity(capacity) {}
+
+	// enough nodes for a search of limits, a full pool only stops the tree from growing
+	static func capacity_for(searchlimits limits) -> int {
+		if (limits.time.count() == 0) return MCTS_MAX_NODES;
+		let nodes = double(limits.time.count()) * limits.threads * MCTS_NODES_PER_MS;
+		return int(clamp(nodes, double(MCTS_MIN_NODES), double(MCTS_MAX_NODES)));
+	}
+
+	func find_best(board& b, searchlimits limits) -> movedata {
+		deadline = limits.time.count() > 0 ? chrono::steady_clock::now() + limits.time : chrono::steady_clock::time_point::max();
+		stop = limits.stop;
+
+		if (not pool) {
+			pool = make_unique<mctspool>(capacity);
+			spare = make_unique<mctspool>(capacity);
+		}
+
+		if (not reuse_tree(b)) {
+			reset(b);
+		}
+		reused_nodes = pool->used;
+
+		var& root = pool->nodes[0];
+		if (root.state != EXPANDED) {
+			var position = root_position;
+			expand(root, position);
+		}
+		if (root.child_count == 0) {
+			return NONE_MOVE;
+		}
+
+		// with neither limit there would be no end, give it a second
+		if (limits.time.count() == 0 && stop == nullptr) {
+			deadline = chrono::steady_clock::now() + chrono::seconds(1);
+		}
+
+		var playout_counts = vector<uint64_t>(limits.threads, 0);
+		var helpers = vector<thread>();
+		for (int i in range(1, limits.threads)) {
+			helpers.emplace_back([&, i]() { playout_counts[i] = work(); });
+		}
+		playout_counts[0] = work();
+		for (var& helper in helpers) {
+			helper.join();
+		}
+		playouts = accumulate(playout_counts.begin(), playout_counts.end(), uint64_t(0));
+
+		// the most visited move is the most trusted one
+		var best = root.first_child;
+		for (int i in range(root.first_child, root.first_child + root.child_count)) {
+			if (pool->nodes[i].visits > pool->nodes[best].visits) {
+				best = i;
+			}
+		}
+		return pool->nodes[best].move;
+	}
+
+private:
+	func reset(board& b) -> void {
+		root_position = b;
+		pool->used = 0;
+		new_node(pool->nodes[pool->allocate(1)], NONE_MOVE, 1);
+		has_tree = true;
+	}
+
+	func new_node(mctsnode& node, movedata move, float prior) -> void {
+		node.move = move;
+		node.prior = prior;
+		node.first_child = 0;
+		node.child_count = 0;
+		node.state = LEAF;
+		node.visits = 0;
+		node.virtual_loss = 0;
+		node.value = 0;
+	}
+
+	// the position to search is usually one or two moves below the old root
+	func reuse_tree(board& b) -> bool {
+		if (not has_tree) return false;
+
+		var& nodes = pool->nodes;
+		if (same_position(root_position, b)) return true;
+
+		let& root = nodes[0];
+		if (root.state != EXPANDED) return false;
+
+		for (int i in range(root.first_child, root.first_child + root.child_count)) {
+			var child_position = root_position;
+			child_position.make_move(nodes[i].move);
+			if (same_position(child_position, b)) {
+				return move_root(i, b);
+			}
+
+			if (nodes[i].state != EXPANDED) continue;
+			for (int j in range(nodes[i].first_child, nodes[i].first_child + nodes[i].child_count)) {
+				var grandchild_position = child_position;
+				grandchild_position.make_move(nodes[j].move);
+				if (same_position(grandchild_position, b)) {
+					return move_root(j, b);
+				}
+			}
+		}
+		return false;
+	}
+
+	// copies the subtree below the new root to the front of the spare pool and swaps the pools
+	func move_root(int new_root, board& b) -> bool {
+		var& from = pool->nodes;
+		var& to = spare->nodes;
+		spare->used = 1;
+
+		var copy = lambda(int source, int target) {
+			new_node(to[target], from[source].move, from[source].prior);
+			to[target].visits = from[source].visits.load();
+			to[target].value = from[source].value.load();
+			to[target].state = from[source].state == EXPANDED ? EXPANDED : LEAF;
+			to[target].child_count = from[source].child_count;
+			to[target].first_child = from[source].first_child;
+		};
+
+		// breadth first, children stay contiguous
+		copy(new_root, 0);
+		for (int target = 0; target < spare->used; target++) {
+			if (to[target].state != EXPANDED) continue;
+
+			let source_first = to[target].first_child;
+			let first = spare->allocate(to[target].child_count);
+			to[target].first_child = first;
+			for (int i in range(to[target].child_count)) {
+				copy(source_first + i, first + i);
+			}
+		}
+
+		swap(pool, spare);
+		root_position = b;
+		return true;
+	}
+
+	func out_of_time() -> bool {
+		return (stop && stop->load(memory_order_relaxed)) || chrono::steady_clock::now() >= deadline;
+	}
+
+	// one thread's share of the search, returns its number of playouts
+	func work() -> uint64_t {
+		var position = root_position;
+		var path = array<mctsnode*, MAX_PLY>();
+		uint64_t count = 0;
+
+		while (not out_of_time()) {
+			static_cast<boardstate&>(position) = root_position;
+
+			// selection, every node on the path gets a virtual loss so other threads look elsewhere
+			var node = &pool->nodes[0];
+			var length = 0;
+			path[length++] = node;
+			node->virtual_loss++;
+
+			while (node->state == EXPANDED && node->child_count > 0 && length < MAX_PLY - 1 && not position.black_won() && not position.white_won()) {
+				node = select(*node);
+				node->virtual_loss++;
+				path[length++] = node;
+				position.make_move(node->move);
+			}
+
+			let terminal = position.black_won() || position.white_won();
+			if (not terminal && node->state == LEAF && node->visits + 1 >= MCTS_EXPAND_VISITS) {
+				var expected = int(LEAF);
+				if (node->state.compare_exchange_strong(expected, EXPANDING)) {
+					var expansion_position = position;
+					expand(*node, expansion_position);
+				}
+			}
+
+			// result for black, in [0, 1]
+			let result = terminal ? (position.black_won() ? 1.0f : 0.0f) : rollout(position);
+
+			// by the side to move, the root has no move to take the color from
+			var mover = opposite(root_position.current_turn);
+			for (int i in range(length)) {
+				var& visited = *path[i];
+				visited.visits++;
+				visited.virtual_loss--;
+				visited.value += mover == BLACK ? result : 1.0f - result;
+				mover = opposite(mover);
+			}
+			count++;
+		}
+		return count;
+	}
+
+	func select(mctsnode& parent) -> mctsnode* {
+		let parent_visits = float(parent.visits + parent.virtual_loss);
+		let exploration = MCTS_EXPLORATION * sqrt(parent_visits + 1);
+
+		// unvisited children start a little below the parent. its value is for the other side
+		let parent_value = parent.visits > 0 ? 1.0f - parent.value / parent.visits : 0.5f;
+		let first_play = max(parent_value - 0.1f, 0.0f);
+
+		var best = &pool->nodes[parent.first_child];
+		var best_score = -1.0f;
+		for (int i in range(parent.first_child, parent.first_child + parent.child_count)) {
+			var& child = pool->nodes[i];
+
+			// a virtual loss counts as a lost visit
+			let visits = float(child.visits + child.virtual_loss);
+			let value = visits > 0 ? child.value / visits : first_play;
+			let score = value + exploration * child.prior / (1 + visits);
+
+			if (score > best_score) {
+				best_score = score;
+				best = &child;
+			}
+		}
+		return best;
+	}
+
+	// children get the softmax of the move ordering scores as priors
+	func expand(mctsnode& node, board& position) -> void {
+		var& list = search_stack[0].moves;
+		movegen(&position, list);
+
+		let first = pool->allocate(list.size());
+		if (first < 0) {
+			// the pool is full, the node stays a leaf that is only rolled out
+			node.state = LEAF;
+			return;
+		}
+
+		var total = 0.0f;
+		for (int i in range(list.size())) {
+			total += exp(list.scores[i] / MCTS_PRIOR_TEMPERATURE);
+		}
+		for (int i in range(list.size())) {
+			new_node(pool->nodes[first + i], list[i], exp(list.scores[i] / MCTS_PRIOR_TEMPERATURE) / total);
+		}
+
+		node.first_child = first;
+		node.child_count = list.size();
+		node.state = EXPANDED;
+	}
+
+	// light policy: the better ordered of two random moves, so captures are usually taken
+	func rollout(board& position) -> float {
+		var& list = search_stack[1].moves;
+
+		for (var ply = 0; ply < MCTS_ROLLOUT_PLIES; ply++) {
+			if (position.black_won()) return 1;
+			if (position.white_won()) return 0;
+
+			movegen(&position, list);
+			if (list.size() == 0) break;
+
+			let first = int(fast_random() % list.size());
+			let second = int(fast_random() % list.size());
+			position.make_move(list[list.scores[first] >= list.scores[second] ? first : second]);
+		}
+
+		return 1 / (1 + exp(-position.evaluate() / MCTS_ROLLOUT_SCALE));
+	}
+};
+
+
+
+
+/////////////
+// PONDERING
+// searching on the opponent's time
+
+// after our move the reply we expect is searched in the background. if the opponent
+// plays it, that search just goes on for what is left of the budget. if not, it is
+// stopped and the real position is searched with the transposition table it filled.
+// without an expected reply the opponent's own position is searched, which fills
+// the table for all replies
+class ponderer {
+private:
+	board position;                 // belongs to the background search while it runs
+	boardstate expected_position;
+	future<movedata> search;
+	atomic<bool> stop = false;
+	bool active = false;
+	bool expecting_reply = false;
+	chrono::steady_clock::time_point started;
+
+public:
+	int hits = 0;
+	int misses = 0;
+
+	~ponderer() {
+		cancel();
+	}
+
+	func start(board& game, searchlimits limits) -> void {
+		cancel();
+
+		// the background search shares the game's tables
+		game.allocate_tables();
+		position = game;
+		let expected = game.legal_move(game.transposition_table->probe(game.boardhash).move);
+		expecting_reply = expected.is_valid();
+		if (expecting_reply) {
+			position.play_move(expected);
+		}
+		expected_position = position;
+
+		// no time limit, it runs until the opponent moved
+		limits.time = chrono::milliseconds(0);
+		limits.clock = chrono::milliseconds(0);
+		limits.stop = &stop;
+		stop = false;
+
+		started = chrono::steady_clock::now();
+		search = async(launch::async, [this, limits]() { return position.find_best(limits); });
+		active = true;
+	}
+
+	// our turn in game. on a hit the pondered time counts against the budget, so a
+	// long enough ponder answers at once. with a game clock the time manager decides
+	// instead, its search starts from the table the ponder search filled
+	func finish(board& game, searchlimits limits) -> movedata {
+		if (active && expecting_reply && same_position(expected_position, game)) {
+			hits++;
+			active = false;
+
+			if (limits.clock.count() > 0) {
+				stop = true;
+				search.wait();
+				return game.find_best(limits);
+			}
+
+			// a depth limited search is simply waited for
+			let budget = limits.time;
+			if (budget.count() > 0) {
+				let pondered = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started);
+				search.wait_for(max(budget - pondered, chrono::milliseconds(0)));
+				stop = true;
+			}
+
+			let move = search.get();
+			return move.is_valid() ? move : game.find_best(limits);
+		}
+
+		if (active) {
+			misses += expecting_reply;
+			cancel();
+		}
+		return game.find_best(limits);
+	}
+
+	func cancel() -> void {
+		if (active) {
+			stop = true;
+			search.wait();
+			active = false;
+		}
+	}
+};
+
+
+
+/////////////////////////
+// PROOF NUMBER SEARCH
+// proves that the side to move can capture its sixth piece within some plies whatever
+// the opponent does, or that it cannot. near the end of the game these forced wins are
+// often deeper than the alpha beta search looks
+
+// depth first proof number search (df-pn). proof and disproof numbers are kept from the
+// view of the side to move: phi is the proof number of a win for it, delta of no win.
+// the solving side is the attacker, the defender wins when the attacker cannot capture
+// in time. the plies left are part of the key, so the searched graph has no cycles
+
+let PN_INFINITE = uint32_t(1) << 30;
+
+// the first proof is looked for within this many plies, a capture each attacker move
+let SOLVE_DEPTH = 9;
+let SOLVE_TIME = chrono::milliseconds(500);
+
+enum proof {
+	UNPROVEN,   // out of time
+	WIN,
+	NO_WIN,     // within the plies searched
+};
+
+struct pnentry {
+	uint64_t key = 0;
+	uint32_t phi = 1;
+	uint32_t delta = 1;
+	uint32_t work = 0;   // nodes searched below it, the entry with the least is replaced first
+};
+
+struct solveresult {
+	proof result = UNPROVEN;
+	int depth = 0;              // the plies of the proof, or of the deepest search that found no win
+	vector<movedata> line;      // the win, against the defence that took the longest to refute
+	uint64_t nodes = 0;
+};
+
+// what mid keeps for a node: its moves and their children's numbers. one per plies left,
+// allocated with the solver, so solving does not allocate
+struct pnframe {
+	movelist moves;
+	array<pnentry, MAX_MOVES> children;
+	array<bool, MAX_MOVES> open;
+};
+
+// the table has a fixed size and is kept between solves, it holds positions for both attackers
+class pnsolver {
+private:
+	static let BUCKET = 4;
+
+	vector<pnentry> table;
+	vector<pnframe> frames = vector<pnframe>(MAX_PLY);
+	uint64_t mask;
+	color attacker;
+	uint64_t nodes = 0;
+	searchlimits limits;
+	chrono::steady_clock::time_point started;
+	bool stopped = false;
+
+public:
+	init pnsolver(int megabytes = 64) {
+		var size = uint64_t(BUCKET);
+		while (size * 2 * sizeof(pnentry) <= uint64_t(megabytes) << 20) size *= 2;
+		table.resize(size);
+		mask = (size - 1) & ~uint64_t(BUCKET - 1);
+	}
+
+	// limits.depth is the most plies to look for a win in, limits.time what to spend on it
+	func solve(board& b, searchlimits limits) -> solveresult {
+		var ret = solveresult();
+		attacker = b.current_turn;
+		nodes = 0;
+		stopped = false;
+		this->limits = limits;
+		started = chrono::steady_clock::now();
+
+		// the attacker moves at odd plies, so those are the depths a win can be proven at
+		for (var depth = 1; depth <= min(limits.depth, MAX_PLY - 1) && not stopped; depth += 2) {
+			mid(b, PN_INFINITE, PN_INFINITE, depth);
+			if (stopped) break;
+
+			let root = lookup(b, depth);
+			if (root.phi == 0) {
+				ret.result = WIN;
+				ret.depth = depth;
+				ret.line = winning_line(b, depth);
+				break;
+			}
+			ret.result = NO_WIN;
+			ret.depth = depth;
+		}
+
+		ret.nodes = nodes;
+		return ret;
+	}
+
+private:
+	func key_for(board& b, int depthleft) -> uint64_t {
+		return b.boardhash ^ (uint64_t(depthleft) * 0x9E3779B97F4A7C15ull) ^ (attacker == WHITE ? 0xD6E8FEB86659FD93ull : 0);
+	}
+
+	func find(uint64_t key) -> pnentry* {
+		let first = key & mask;
+		for (int i in range(BUCKET)) {
+			if (table[first + i].key == key) return &table[first + i];
+		}
+		return nullptr;
+	}
+
+	func store(uint64_t key, uint32_t phi, uint32_t delta, uint32_t work) -> void {
+		var entry = find(key);
+		if (not entry) {
+			let first = key & mask;
+			entry = &table[first];
+			for (int i in range(1, BUCKET)) {
+				if (table[first + i].work < entry->work) entry = &table[first + i];
+			}
+		}
+		*entry = pnentry{ key, phi, delta, work };
+	}
+
+	// without a move to make: the attacker has won, the defender has, or the attacker cannot
+	// capture often enough in the plies left
+	func decided(board& b, int depthleft, uint32_t& phi, uint32_t& delta) -> bool {
+		let needed = 6 - (attacker == BLACK ? b.captured_white_pieces : b.captured_black_pieces);
+		let attacker_moves = (depthleft + (b.current_turn == attacker)) / 2;
+		let defender_won = (attacker == BLACK ? b.captured_black_pieces : b.captured_white_pieces) >= 6;
+
+		if (needed > 0 && not defender_won && needed <= attacker_moves) return false;
+
+		let winner = needed <= 0 ? attacker : opposite(attacker);
+		phi = winner == b.current_turn ? 0 : PN_INFINITE;
+		delta = winner == b.current_turn ? PN_INFINITE : 0;
+		return true;
+	}
+
+	// the numbers of the position, from the table or as a new leaf
+	func lookup(board& b, int depthleft) -> pnentry {
+		var ret = pnentry{ key_for(b, depthleft) };
+		if (decided(b, depthleft, ret.phi, ret.delta)) return ret;
+
+		let entry = find(ret.key);
+		return entry ? *entry : ret;
+	}
+
+	func out_of_time() -> bool {
+		if (limits.stop && limits.stop->load(memory_order_relaxed)) return true;
+		return limits.time.count() > 0 && chrono::steady_clock::now() - started >= limits.time;
+	}
+
+	// searches the position until its phi reaches phi_limit or its delta delta_limit
+	func mid(board& b, uint32_t phi_limit, uint32_t delta_limit, int depthleft) -> void {
+		nodes++;
+		if ((nodes & 1023) == 0 && out_of_time()) stopped = true;
+		if (stopped) return;
+
+		var phi = PN_INFINITE, delta = uint32_t(0);
+		if (decided(b, depthleft, phi, delta)) return;
+
+		let nodes_before = nodes;
+		let key = key_for(b, depthleft);
+
+		// the moves are made once for the keys, after that the children are only looked up
+		var& frame = frames[depthleft];
+		var& list = frame.moves;
+		var& children = frame.children;
+		var& open = frame.open;
+		var movepick = movegen(&b, list);
+		for (int i in range(movepick.size())) {
+			b.make_move(list[i]);
+			children[i] = pnentry{ key_for(b, depthleft - 1) };
+			open[i] = not decided(b, depthleft - 1, children[i].phi, children[i].delta);
+			b.undo_move(list[i]);
+		}
+
+		loop() {
+			// phi is the best child's delta, delta the sum of the children's phi
+			phi = PN_INFINITE;
+			delta = 0;
+			var best = -1;
+			var second_delta = PN_INFINITE;
+			for (int i in range(movepick.size())) {
+				if (open[i]) {
+					let entry = find(children[i].key);
+					children[i] = entry ? *entry : pnentry{ children[i].key };
+				}
+
+				delta = min(delta + children[i].phi, PN_INFINITE);
+				if (children[i].delta < phi) {
+					second_delta = phi;
+					phi = children[i].delta;
+					best = i;
+				}
+				else if (children[i].delta < second_delta) {
+					second_delta = children[i].delta;
+				}
+			}
+
+			if (phi >= phi_limit || delta >= delta_limit || stopped) break;
+
+			let child_phi_limit = delta_limit - delta + children[best].phi;
+			let child_delta_limit = min(phi_limit, second_delta + 1);
+			b.make_move(list[best]);
+			mid(b, child_phi_limit, child_delta_limit, depthleft - 1);
+			b.undo_move(list[best]);
+		}
+
+		var work = uint32_t(min<uint64_t>(nodes - nodes_before + 1, UINT32_MAX));
+		if (let entry = find(key)) work = uint32_t(min<uint64_t>(uint64_t(entry->work) + work, UINT32_MAX));
+		store(key, phi, delta, work);
+	}
+
+	// follows the proof: the attacker takes the quickest winning move, the defender the
+	// reply that took the most work to refute. entries pushed out of the table are proven again
+	func winning_line(board b, int depthleft) -> vector<movedata> {
+		var line = vector<movedata>();
+		for (; not (b.black_won() || b.white_won()) && depthleft > 0; depthleft--) {
+			mid(b, PN_INFINITE, PN_INFINITE, depthleft);
+			if (stopped) break;
+
+			var list = movelist();
+			var movepick = movegen(&b, list);
+
+			var chosen = NONE_MOVE;
+			var chosen_work = uint32_t(0);
+			for (var move in movepick) {
+				b.make_move(move);
+				let child = lookup(b, depthleft - 1);
+				b.undo_move(move);
+
+				// the child is lost for the side to move there
+				let attacker_move = b.current_turn == attacker;
+				if (attacker_move && child.delta == 0 && (not chosen.is_valid() || child.work < chosen_work)) {
+					chosen = move;
+					chosen_work = child.work;
+				}
+				if (not attacker_move && (not chosen.is_valid() || child.work > chosen_work)) {
+					chosen = move;
+					chosen_work = child.work;
+				}
+			}
+
+			if (not chosen.is_valid()) break;
+			line.push_back(chosen);
+			b.make_move(chosen);
+		}
+		return line;
+	}
+};
+
+// the end of the game, when the solver is worth a try
+func near_end(board& b) -> bool {
+	return b.captured_black_pieces >= 4 || b.captured_white_pieces >= 4;
+}
+
+
+
+
+//////////
+// TOOLS
+// perft, benchmark and match runner. they are built into the same binary and
+// picked by the executable name (abalone_perft, ...) or by the first argument
+
+let BENCH_POSITIONS = array<string, 6> {
+	STARTING_BOARD,
+	TESTING_BOARD,
+	"B:.BBBBB..B...B..BB...BBB.B..B....W.WW..W....WW...W.WW..WWWWW..",
+	"B:BBB...BB.BB....B.B...BB..........W.B.BWW....WW..W.BW..WWW.WWW",
+	"B:....B..B..............BBB....BBBBB...BBBWW.W.B..WW.W.W.W.W..W",
+	"B:.......B..W..BBB....BBB.W....BB.W.WW..BBB..W.B.B...WW...W....",
+};
+
+// how many positions the batch evaluation is timed on
+let BATCH_BENCH_POSITIONS = size_t(16384);
+
+func elapsed_ms(chrono::steady_clock::time_point start) -> double {
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+func per_second(uint64_t count, double ms) -> uint64_t {
+	return ms > 0 ? uint64_t(count * 1000.0 / ms) : 0;
+}
+
+func arg_or(vector<string>& args, int index, string fallback) -> string {
+	return index < int(args.size()) ? args[index] : fallback;
+}
+
+
+// counts leaf nodes of the full move tree, checks movegen, make_move and undo_move
+// (or the copies with ABALONE_COPY_MAKE)
+func perft(board& b, int depth) -> uint64_t {
+#ifdef ABALONE_VERIFY_HASH
+	b.verify_hash();
+#endif
+	if (depth == 0 || b.black_won() || b.white_won()) {
+		return 1;
+	}
+
+	var& frame = search_stack[depth];
+	var movepick = movegen(&b, frame.moves);
+	if (depth == 1) {
+		return movepick.size();
+	}
+
+	uint64_t count = 0;
+	for (var move in movepick) {
+		b.push_move(move, frame);
+		count += perft(b, depth - 1);
+		b.pop_move(move, frame);
+	}
+	return count;
+}
+
+// usage: perft [depth=3] [position]
+func run_perft(vector<string> args) -> int {
+	let maxdepth = stoi(arg_or(args, 0, "3"));
+	var b = parse_to_board(arg_or(args, 1, STARTING_BOARD));
+
+	for (int depth in range(1, maxdepth + 1)) {
+		let start = chrono::steady_clock::now();
+		let count = perft(b, depth);
+		let ms = elapsed_ms(start);
+
+		cout << "perft " << depth << ": " << count << " nodes, " << fixed << setprecision(1) << ms << " ms, " << per_second(count, ms) << " nps\n";
+	}
+	return 0;
+}
+
+
+// usage: bench [depth=5] [lines=4] [threads=4]
+// fixed positions, fixed depth. the summary line is what the pgo training run and regressions look at.
+// the multipv line compares iterative deepening with the given number of lines against a single line,
+// the ybw line the reproducible parallel search against the same search on one thread
+func run_bench(vector<string> args) -> int {
+	let depth = stoi(arg_or(args, 0, "5"));
+	let lines = stoi(arg_or(args, 1, "4"));
+	let threads = stoi(arg_or(args, 2, "4"));
+
+	uint64_t total_nodes = 0;
+	uint64_t total_allocations = 0;
+	uint64_t eval_probes = 0, eval_hits = 0;
+	var total_ms = 0.0;
+
+	// the first use allocates this thread's search stack, that is startup and not search
+	(void)search_stack.front();
+
+#ifdef ABALONE_COPY_MAKE
+	print("copy-make search, " + to_string(sizeof(boardstate)) + " bytes copied per ply");
+#else
+	print("make/unmake search");
+#endif
+	print(network ? "network evaluation" : "handcrafted evaluation");
+
+	// the tables are allocated before the clock starts, the search itself must not allocate
+	for (var position in BENCH_POSITIONS) {
+		var b = parse_to_board(position);
+		b.allocate_tables();
+
+		let allocations_before = allocations.load();
+		let start = chrono::steady_clock::now();
+		var move = b.find_best(depth);
+		let ms = elapsed_ms(start);
+		let search_allocations = allocations.load() - allocations_before;
+
+		total_nodes += b.stats.nodes;
+		total_allocations += search_allocations;
+		eval_probes += b.stats.eval_probes;
+		eval_hits += b.stats.eval_hits;
+		total_ms += ms;
+
+		cout << position << "  " << setw(10) << b.stats.nodes << " nodes " << setw(9) << fixed << setprecision(1) << ms << " ms " << setw(4) << search_allocations << " allocs  " << serilize_move(move);
+	}
+
+	cout << "bench: " << total_nodes << " nodes, " << fixed << setprecision(1) << total_ms << " ms, " << per_second(total_nodes, total_ms) << " nps, " << total_allocations << " allocations\n";
+
+	// the same searches again, evaluating every leaf
+	var uncached_ms = 0.0;
+	for (var position in BENCH_POSITIONS) {
+		var b = parse_to_board(position);
+		b.cache_evaluations = false;
+		b.allocate_tables();
+		let start = chrono::steady_clock::now();
+		b.find_best(depth);
+		uncached_ms += elapsed_ms(start);
+	}
+
+	cout << "eval cache: " << setprecision(1) << eval_hits * 100.0 / max<uint64_t>(eval_probes, 1) << "% of " << eval_probes << " leaves, " << uncached_ms << " ms without, "
+		<< setprecision(2) << uncached_ms / max(total_ms, 0.001) << "x speedup\n";
+
+	uint64_t single_nodes = 0, multi_nodes = 0;
+	var single_ms = 0.0, multi_ms = 0.0;
+	for (var position in BENCH_POSITIONS) {
+		for (var k in { 1, lines }) {
+			var b = parse_to_board(position);
+			b.allocate_tables();
+			let start = chrono::steady_clock::now();
+			b.find_best_lines(searchlimits{ depth }, k);
+			(k == 1 ? single_ms : multi_ms) += elapsed_ms(start);
+			(k == 1 ? single_nodes : multi_nodes) += b.stats.nodes;
+		}
+	}
+
+	if (threads > 1) {
+		uint64_t serial_nodes = 0, parallel_nodes = 0;
+		var serial_ms = 0.0, parallel_ms = 0.0;
+		var differences = 0;
+		for (var position in BENCH_POSITIONS) {
+			var serial = parse_to_board(position);
+			serial.reproducible = true;
+			serial.allocate_tables();
+			var start = chrono::steady_clock::now();
+			let serial_move = serial.find_best(searchlimits{ depth });
+			serial_ms += elapsed_ms(start);
+			serial_nodes += serial.stats.nodes;
+
+			var parallel = parse_to_board(position);
+			parallel.allocate_tables();
+			start = chrono::steady_clock::now();
+			let parallel_move = parallel.find_best(searchlimits{ depth, chrono::milliseconds(0), threads });
+			parallel_ms += elapsed_ms(start);
+			parallel_nodes += parallel.stats.nodes;
+
+			let serial_score = serial.transposition_table->probe(serial.boardhash).score;
+			let parallel_score = parallel.transposition_table->probe(parallel.boardhash).score;
+			if (serial_move.bits != parallel_move.bits || serial_score != parallel_score) {
+				differences++;
+			}
+		}
+
+		cout << "ybw " << threads << " threads: " << parallel_nodes << " nodes, " << setprecision(1) << parallel_ms << " ms, one thread " << serial_nodes << " nodes, " << serial_ms << " ms, "
+			<< setprecision(2) << serial_ms / max(parallel_ms, 0.001) << "x speedup, " << showpos << setprecision(0) << (parallel_nodes * 100.0 / max<uint64_t>(serial_nodes, 1) - 100) << noshowpos << "% nodes, "
+			<< differences << " different results\n";
+	}
+
+	cout << "multipv " << lines << ": " << multi_nodes << " nodes, " << setprecision(1) << multi_ms << " ms, single pv " << single_nodes << " nodes, " << single_ms << " ms, "
+		<< showpos << setprecision(0) << (multi_nodes * 100.0 / max<uint64_t>(single_nodes, 1) - 100) << noshowpos << "% nodes\n";
+
+	// time to depth with the loaded probcut fits against searching every node
+	if (probcut_model) {
+		uint64_t pruned_nodes = 0, full_nodes = 0;
+		var pruned_ms = 0.0, full_ms = 0.0;
+		var same_moves = 0;
+		for (var position in BENCH_POSITIONS) {
+			var moves = array<uint16_t, 2>();
+			for (var pruned in { true, false }) {
+				var b = parse_to_board(position);
+				b.probcut = pruned;
+				b.allocate_tables();
+				let start = chrono::steady_clock::now();
+				moves[pruned] = b.find_best(searchlimits{ depth }).id();
+				(pruned ? pruned_ms : full_ms) += elapsed_ms(start);
+				(pruned ? pruned_nodes : full_nodes) += b.stats.nodes;
+			}
+			same_moves += moves[0] == moves[1];
+		}
+
+		cout << "probcut: " << pruned_nodes << " nodes, " << setprecision(1) << pruned_ms << " ms, without " << full_nodes << " nodes, " << full_ms << " ms, "
+			<< setprecision(2) << full_ms / max(pruned_ms, 0.001) << "x speedup, " << same_moves << " of " << BENCH_POSITIONS.size() << " same moves\n";
+	}
+
+	// random playouts from the bench positions, evaluated one by one and as a batch
+	var positions = vector<boardstate>();
+	while (positions.size() < BATCH_BENCH_POSITIONS) {
+		for (var position in BENCH_POSITIONS) {
+			var b = parse_to_board(position);
+			for (int ply = 0; ply < 40 && not b.black_won() && not b.white_won(); ply++) {
+				b.make_move(b.find_random());
+				positions.push_back(b);
+			}
+		}
+	}
+
+	var single = parse_to_board(STARTING_BOARD);
+	single.eval = HANDCRAFTED;
+	var expected = vector<int>(positions.size());
+	var start = chrono::steady_clock::now();
+	for (int i in range(int(positions.size()))) {
+		static_cast<boardstate&>(single) = positions[i];
+		expected[i] = single.evaluate();
+	}
+	let single_eval_ms = elapsed_ms(start);
+
+	var batch = positionbatch(int(positions.size()));
+	for (int i in range(int(positions.size()))) {
+		batch.set(i, positions[i]);
+	}
+	var scores = vector<int>();
+	start = chrono::steady_clock::now();
+	batch.evaluate(scores);
+	let batch_ms = elapsed_ms(start);
+
+	var mismatches = 0;
+	for (int i in range(int(positions.size()))) {
+		mismatches += scores[i] != expected[i];
+	}
+	cout << "batch eval: " << positions.size() << " positions, " << setprecision(1) << single_eval_ms * 1e6 / positions.size() << " ns one by one, "
+		<< batch_ms * 1e6 / positions.size() << " ns batched, " << setprecision(2) << single_eval_ms / max(batch_ms, 0.001) << "x speedup, " << mismatches << " mismatches\n";
+	return mismatches == 0 ? 0 : 1;
+}
+
+
+// usage: analyze [depth=5] [lines=4] [position]
+// the best root moves with their scores and principal variations
+func run_analyze(vector<string> args) -> int {
+	let depth = stoi(arg_or(args, 0, "5"));
+	let lines = stoi(arg_or(args, 1, "4"));
+	var b = parse_to_board(arg_or(args, 2, STARTING_BOARD));
+
+	let start = chrono::steady_clock::now();
+	let result = b.find_best_lines(searchlimits{ depth }, lines);
+	let ms = elapsed_ms(start);
+
+	for (int i in range(int(result.size()))) {
+		cout << i + 1 << ". " << setw(8) << result[i].score << " ";
+		for (var move in result[i].pv) {
+			var text = serilize_move(move);
+			text.pop_back();   // the newline
+			cout << " " << text;
+		}
+		cout << "\n";
+	}
+	cout << "analyze: depth " << depth << ", " << b.stats.nodes << " nodes, " << fixed << setprecision(1) << ms << " ms\n";
+	return 0;
+}
+
+
+// usage: calibrate [file=probcut.txt] [maxdepth=6] [positions=200] [positions file]
+// fits the probcut parameters. for every depth from PROBCUT_MIN_DEPTH on, each position is
+// searched to that depth and PROBCUT_REDUCTION plies shallower, each time with an empty
+// table, and a least squares line is put through the pairs of scores. the positions are
+// one per line of the file, or come from games of random and shallow searched moves
+// that start at the bench positions
+func run_calibrate(vector<string> args) -> int {
+	let path = arg_or(args, 0, "probcut.txt");
+	let maxdepth = min(stoi(arg_or(args, 1, "6")), MAX_PLY - 1);
+	let count = stoi(arg_or(args, 2, "200"));
+
+	// one small table for every search, it is cleared before each of the measured ones
+	let table = make_shared<transtable>(18);
+
+	var positions = vector<boardstate>();
+	if (args.size() > 3) {
+		var file = ifstream(args[3]);
+		for (var line = string(); getline(file, line);) {
+			if (not line.empty()) positions.push_back(parse_to_board(line));
+		}
+	}
+	else {
+		srand(1);
+		for (int i = 0; int(positions.size()) < count; i++) {
+			var b = parse_to_board(BENCH_POSITIONS[i % BENCH_POSITIONS.size()]);
+			b.transposition_table = table;
+			let plies = 2 + rand() % 30;
+			for (int ply = 0; ply < plies && not b.black_won() && not b.white_won(); ply++) {
+				b.play_move(rand() % 2 ? b.find_random() : b.find_best(2));
+			}
+			if (not b.black_won() && not b.white_won()) {
+				positions.push_back(b);
+			}
+		}
+	}
+
+	var b = parse_to_board(STARTING_BOARD);
+	b.transposition_table = table;
+	func score_at = lambda(const boardstate& position, int depth) {
+		static_cast<boardstate&>(b) = position;
+		b.key_history.clear();
+		b.reversible_plies = 0;
+		b.transposition_table->clear();
+		var move = movedata();
+		return b.search_root(depth, move);
+	};
+
+	var model = probcutmodel();
+	for (int depth in range(PROBCUT_MIN_DEPTH, maxdepth + 1)) {
+		let shallow = depth - PROBCUT_REDUCTION;
+		var xs = vector<double>();
+		var ys = vector<double>();
+		var shallow_ms = 0.0, deep_ms = 0.0;
+		for (var& position in positions) {
+			var start = chrono::steady_clock::now();
+			let x = score_at(position, shallow);
+			shallow_ms += elapsed_ms(start);
+
+			start = chrono::steady_clock::now();
+			let y = score_at(position, depth);
+			deep_ms += elapsed_ms(start);
+
+			// a won game is not what the line is for
+			if (abs(x) < PROBCUT_MAX_SCORE && abs(y) < PROBCUT_MAX_SCORE) {
+				xs.push_back(x);
+				ys.push_back(y);
+			}
+		}
+
+		let n = double(xs.size());
+		let mean_x = accumulate(xs.begin(), xs.end(), 0.0) / max(n, 1.0);
+		let mean_y = accumulate(ys.begin(), ys.end(), 0.0) / max(n, 1.0);
+		var sxx = 0.0, syy = 0.0, sxy = 0.0;
+		for (int i in range(int(xs.size()))) {
+			sxx += (xs[i] - mean_x) * (xs[i] - mean_x);
+			syy += (ys[i] - mean_y) * (ys[i] - mean_y);
+			sxy += (xs[i] - mean_x) * (ys[i] - mean_y);
+		}
+
+		// without a positive slope the shallow score says nothing, this depth is not pruned
+		if (xs.size() < 10 || sxx <= 0 || sxy <= 0) {
+			cout << "depth " << depth << " from " << shallow << ": no fit, " << xs.size() << " positions\n";
+			continue;
+		}
+
+		var& fit = model.fits[depth];
+		fit.shallow = shallow;
+		fit.a = sxy / sxx;
+		fit.b = mean_y - fit.a * mean_x;
+		var squares = 0.0;
+		for (int i in range(int(xs.size()))) {
+			let error = ys[i] - (fit.a * xs[i] + fit.b);
+			squares += error * error;
+		}
+		fit.sigma = sqrt(squares / n);
+
+		cout << "depth " << depth << " from " << shallow << ": a " << fixed << setprecision(3) << fit.a << ", b " << setprecision(1) << fit.b << ", sigma " << fit.sigma
+			<< ", r " << setprecision(3) << sxy / sqrt(sxx * max(syy, 1e-9)) << ", " << xs.size() << " positions, " << setprecision(0) << shallow_ms << " ms shallow, " << deep_ms << " ms deep\n";
+	}
+
+	if (not model.save(path)) {
+		cerr << "could not write " << path << "\n";
+		return 1;
+	}
+	cout << "calibrate: wrote " << path << "\n";
+	return 0;
+}
+
+
+// usage: solve [depth=9] [ms=5000] [megabytes=64] [position]
+// tries to prove a forced win for the side to move, searches normally if there is none
+func run_solve(vector<string> args) -> int {
+	let depth = stoi(arg_or(args, 0, to_string(SOLVE_DEPTH)));
+	let ms = stoi(arg_or(args, 1, "5000"));
+	let megabytes = stoi(arg_or(args, 2, "64"));
+	var b = parse_to_board(arg_or(args, 3, SOLVE_BOARD));
+
+	var solver = pnsolver(megabytes);
+	let start = chrono::steady_clock::now();
+	let result = solver.solve(b, searchlimits{ depth, chrono::milliseconds(ms) });
+	let solve_ms = elapsed_ms(start);
+
+	let names = array<string, 3>{ "unproven", "win", "no win" };
+	cout << "solve: " << names[result.result] << " in " << result.depth << " plies, " << result.nodes << " nodes, "
+		<< fixed << setprecision(1) << solve_ms << " ms, " << per_second(result.nodes, solve_ms) << " nodes/s\n";
+
+	if (result.result == WIN) {
+		cout << "line:";
+		for (var move in result.line) {
+			var text = serilize_move(move);
+			text.pop_back();
+			cout << " " << text;
+		}
+		cout << "\n";
+		return 0;
+	}
+
+	// the fallback, what a player with +solve would do
+	var move = b.find_best(searchlimits{ 5 });
+	var text = serilize_move(move);
+	text.pop_back();
+	cout << "search: " << text << " " << b.transposition_table->probe(b.boardhash).score << " at depth 5\n";
+	return 0;
+}
+
+
+// usage: nnue <file>
+// writes the seed network (see seed_network) and checks that the loaded network
+// agrees with the handcrafted positional score, and its accumulators with a refresh
+func run_nnue(vector<string> args) -> int {
+	let path = arg_or(args, 0, "seed.nnue");
+	if (not seed_network()->save(path) || not load_network(path)) {
+		cerr << "could not write " << path << "\n";
+		return 1;
+	}
+
+	var mismatches = 0;
+	func check = lambda(board& b) {
+		var positional = 0;
+		for (int x in range(9)) {
+			for (int y in range(9)) {
+				positional += b.pieces[x][y].piececolor * SCORE_MAP[x][y];
+			}
+		}
+
+		var refreshed = accumulator();
+		network->refresh(refreshed, b.pieces);
+		if (network->evaluate(b.features) != positional || refreshed.values != b.features.values) {
+			mismatches++;
+		}
+	};
+
+	// random games, every move is also taken back and made again
+	for (var position in BENCH_POSITIONS) {
+		var b = parse_to_board(position);
+		for (int ply = 0; ply < 40 && not b.black_won() && not b.white_won(); ply++) {
+			let move = b.find_random();
+			b.make_move(move);
+			check(b);
+			b.undo_move(move);
+			check(b);
+			b.make_move(move);
+		}
+	}
+
+#ifdef __AVX2__
+	print("avx2 kernels");
+#else
+	print("scalar kernels");
+#endif
+	cout << "nnue: wrote " << path << ", " << mismatches << " mismatches\n";
+	return mismatches == 0 ? 0 : 1;
+}
+
+
+// a player in the match runner:
+//  random
+//  ab:<depth>              alpha beta to a fixed depth
+//  ab:<ms>ms               alpha beta with a time budget per move
+//  mcts:<ms>ms[:<threads>] monte carlo tree search with a time budget per move
+//  tm:<ms>                 alpha beta with a clock of ms for the game, spent by the time manager
+//  flat:<ms>               the same clock, every move gets an even share of what is left
+// followed by any of
+//  +ponder                 alpha beta only, search on the opponent's time
+//  +nnue, +hce             evaluate with the loaded network or the handcrafted evaluation
+//  +solve                  alpha beta only, near the end of the game play a proven win if there is one
+//  +probcut, +noprobcut    prune with the loaded probcut fits or search every node, the default
+struct player {
+	string name;
+	int depth = 0;
+	searchlimits limits;
+	shared_ptr<mcts> tree;
+	shared_ptr<ponderer> pondering;
+	shared_ptr<pnsolver> solver;
+	evaluator eval = network ? NETWORK : HANDCRAFTED;
+	bool probcut = false;
+	double used_ms = 0;
+	int moves = 0;
+
+	double clock_ms = 0;      // for the game, 0 without a clock
+	bool adaptive = false;
+	double game_ms = 0;       // used in the current game
+	int over_clock = 0;       // games that took longer than the clock
+
+	shared_ptr<transtable> table;   // its own, so the players of a game do not use each other's searches
+};
+
+func parse_player(string spec) -> player {
+	var ret = player{ spec };
+
+	var options = stringstream(spec);
+	getline(options, spec, '+');
+	for (var option = string(); getline(options, option, '+');) {
+		if (option is "ponder") ret.pondering = make_shared<ponderer>();
+		if (option is "nnue") ret.eval = NETWORK;
+		if (option is "hce") ret.eval = HANDCRAFTED;
+		if (option is "solve") ret.solver = make_shared<pnsolver>();
+		if (option is "probcut") ret.probcut = true;
+		if (option is "noprobcut") ret.probcut = false;
+	}
+
+	var fields = vector<string>();
+	var stream = stringstream(spec);
+	for (var field = string(); getline(stream, field, ':');) {
+		fields.push_back(field);
+	}
+
+	let budget = arg_or(fields, 1, "1000ms");
+	if (budget.ends_with("ms")) {
+		ret.limits.time = chrono::milliseconds(stoi(budget));
+	}
+
+	if (fields[0] is "ab" && not budget.ends_with("ms")) {
+		ret.depth = stoi(budget);
+	}
+	if (fields[0] is "tm" || fields[0] is "flat") {
+		ret.clock_ms = stoi(budget);
+		ret.adaptive = fields[0] is "tm";
+	}
+	if (fields[0] is "mcts") {
+		ret.limits.threads = stoi(arg_or(fields, 2, "1"));
+		ret.tree = make_shared<mcts>(mcts::capacity_for(ret.limits));
+	}
+	return ret;
+}
+
+func choose_move(board& b, player& p) -> movedata {
+	let start = chrono::steady_clock::now();
+	b.eval = p.eval;
+	b.probcut = p.probcut;
+	if (not p.table) p.table = make_shared<transtable>();
+	b.transposition_table = p.table;
+
+	if (p.clock_ms > 0) {
+		let left = chrono::milliseconds(max(int64_t(p.clock_ms - p.game_ms), int64_t(1)));
+		p.limits.clock = p.adaptive ? left : chrono::milliseconds(0);
+		p.limits.time = p.adaptive ? chrono::milliseconds(0) : max(left / MOVES_TO_GO, chrono::milliseconds(1));
+	}
+
+	// a proven win is played without searching, otherwise the search runs as always. the
+	// solver gets a quarter of the move's share and the search what is left of the budget
+	var move = movedata();
+	var limits = p.limits;
+	if (p.solver && near_end(b)) {
+		let solve_time = limits.clock.count() > 0 ? limits.clock / MOVES_TO_GO / 4 : limits.time.count() > 0 ? limits.time / 4 : SOLVE_TIME;
+		let result = p.solver->solve(b, searchlimits{ SOLVE_DEPTH, max(solve_time, chrono::milliseconds(1)) });
+		if (result.result == WIN) move = result.line.front();
+
+		let solved = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+		if (limits.clock.count() > 0) limits.clock = max(limits.clock - solved, chrono::milliseconds(1));
+		if (limits.time.count() > 0) limits.time = max(limits.time - solved, chrono::milliseconds(1));
+	}
+
+	if (move.is_valid()) {
+		if (p.pondering) p.pondering->cancel();
+	}
+	else if (p.name is "random") {
+		move = b.find_random();
+	}
+	else if (p.tree) {
+		move = p.tree->find_best(b, limits);
+	}
+	else if (p.pondering) {
+		if (p.depth > 0) {
+			limits.depth = p.depth;
+			limits.time = chrono::milliseconds(0);
+		}
+		move = p.pondering->finish(b, limits);
+	}
+	else if (p.depth > 0) {
+		move = b.find_best(p.depth);
+	}
+	else {
+		move = b.find_best(limits);
+	}
+
+	let ms = elapsed_ms(start);
+	p.used_ms += ms;
+	p.game_ms += ms;
+	p.moves++;
+	return move;
+}
+
+func start_pondering(board& b, player& p) -> void {
+	if (p.pondering) {
+		var limits = p.limits;
+		if (p.depth > 0) {
+			limits.depth = p.depth;
+		}
+		p.pondering->start(b, limits);
+	}
+}
+
+// plays one game, returns BLACK or WHITE for the winner and EMPTY for a draw. it starts
+// with opening random moves, so fixed depth players do not play the same game every time
+func play_game(player& black, player& white, int maxmoves, int opening) -> color {
+	var b = parse_to_board(STARTING_BOARD);
+	for (var p in { &black, &white }) {
+		p->game_ms = 0;
+		if (p->table) p->table->clear();
+	}
+
+	for (int ply = 0; ply < opening && not b.black_won() && not b.white_won(); ply++) {
+		b.play_move(b.find_random());
+	}
+
+	var winner = EMPTY;
+	for (var moves = 0; moves < maxmoves && winner == EMPTY; moves++) {
+		var& mover = b.current_turn == BLACK ? black : white;
+		var move = choose_move(b, mover);
+		b.play_move(move);
+		start_pondering(b, mover);
+
+		if (b.black_won()) winner = BLACK;
+		if (b.white_won()) winner = WHITE;
+
+		// the third time a position is on the board it is a draw
+		if (b.count_repetitions() >= 2) break;
+	}
+
+	for (var p in { &black, &white }) {
+		if (p->pondering) p->pondering->cancel();
+		if (p->clock_ms > 0 && p->game_ms > p->clock_ms) p->over_clock++;
+	}
+	return winner;
+}
+
+// usage: match [first=ab:5] [second=random] [games=10] [maxmoves=200] [seed=1] [opening=4]
+// the players swap colors every game, both games of a pair start with the same opening random moves
+func run_match(vector<string> args) -> int {
+	var first = parse_player(arg_or(args, 0, "ab:5"));
+	var second = parse_player(arg_or(args, 1, "random"));
+	let games = stoi(arg_or(args, 2, "10"));
+	let maxmoves = stoi(arg_or(args, 3, "200"));
+	let seed = stoi(arg_or(args, 4, "1"));
+	let opening = stoi(arg_or(args, 5, "4"));
+
+	if ((first.eval == NETWORK || second.eval == NETWORK) && not network) {
+		cerr << "+nnue needs a network, pass --network=<file>\n";
+		return 1;
+	}
+	if ((first.probcut || second.probcut) && not probcut_model) {
+		cerr << "+probcut needs its parameters, pass --probcut=<file>\n";
+		return 1;
+	}
+
+	var first_wins = 0;
+	var second_wins = 0;
+	var draws = 0;
+
+	for (int game in range(games)) {
+		srand(seed + game / 2);
+
+		let first_is_black = (game % 2 == 0);
+		let winner = first_is_black ? play_game(first, second, maxmoves, opening) : play_game(second, first, maxmoves, opening);
+
+		if (winner == EMPTY) {
+			draws++;
+		}
+		else if ((winner == BLACK) == first_is_black) {
+			first_wins++;
+		}
+		else {
+			second_wins++;
+		}
+
+		cout << "game " << game + 1 << ": " << first.name << " +" << first_wins << " " << second.name << " +" << second_wins << " =" << draws << "\n";
+	}
+
+	cout << "match: " << first.name << " " << first_wins << " - " << second_wins << " " << second.name << ", " << draws << " draws\n";
+	cout << "time: " << first.name << " " << fixed << setprecision(0) << first.used_ms << " ms, " << second.name << " " << second.used_ms << " ms\n";
+	cout << "per move: " << first.name << " " << setprecision(1) << first.used_ms / max(first.moves, 1) << " ms, " << second.name << " " << second.used_ms / max(second.moves, 1) << " ms\n";
+
+	for (var p in { &first, &second }) {
+		if (p->pondering) {
+			cout << "ponder: " << p->name << " " << p->pondering->hits << " hits, " << p->pondering->misses << " misses\n";
+		}
+		if (p->clock_ms > 0) {
+			cout << "clock: " << p->name << " " << p->over_clock << " games over the clock\n";
+		}
+	}
+	return 0;
+}
+
+
+
+////////////////
+// GAME SERVER
+// many games in one process. between moves a game only keeps its position, the
+// searches of all games run on one pool of threads that share a transposition table
+
+// what a game keeps while it waits for its next move, a few hundred bytes
+struct gamesession {
+	boardstate position;
+	vector<uint64_t> key_history;   // the last keys since a capture, at most SESSION_HISTORY
+	int reversible_plies = 0;
+	int depth = 0;
+	double clock_ms = 0;            // left of the game's time budget
+	double used_ms = 0;             // searched so far, the queue serves the game with the least first
+	bool busy = false;              // a request is queued or running
+};
+
+// repetitions further back than this are not found in server games
+let SESSION_HISTORY = MAX_PLY;
+
+enum requestkind {
+	BEST_MOVE,
+	RANDOM_MOVE,
+};
+
+// called on a server thread with the move, already played, and the position after it.
+// NONE_MOVE if the game was over
+using movecallback = function<void(movedata, const boardstate&)>;
+
+struct moverequest {
+	int game;
+	requestkind kind;
+	movecallback done;
+	chrono::steady_clock::time_point submitted;
+	double priority;     // the game's used_ms when the request was queued
+	uint64_t sequence;   // ties go to the older request
+};
+
+struct laterrequest {
+	func operator()(const moverequest& a, const moverequest& b) const -> bool {
+		return a.priority != b.priority ? a.priority > b.priority : a.sequence > b.sequence;
+	}
+};
+
+// latencies counted in buckets 10% apart, so the percentiles need no list of every request
+struct latencyhistogram {
+	static let BUCKETS = 200;   // 1 microsecond to several minutes
+
+	array<uint64_t, BUCKETS> counts{};
+	uint64_t total = 0;
+	double max_ms = 0;
+
+	func add(double ms) -> void {
+		let bucket = ms * 1000 <= 1 ? 0 : int(log(ms * 1000) / log(1.1));
+		counts[min(bucket, BUCKETS - 1)]++;
+		total++;
+		max_ms = max(max_ms, ms);
+	}
+
+	// the upper end of the bucket the p-th percentile is in
+	func percentile(double p) const -> double {
+		var seen = uint64_t(0);
+		for (int i in range(BUCKETS)) {
+			seen += counts[i];
+			if (total > 0 && seen >= p / 100 * total) return min(pow(1.1, i + 1) / 1000, max_ms);
+		}
+		return max_ms;
+	}
+};
+
+class gameserver {
+private:
+	shared_ptr<transtable> table;
+	vector<board> workers;          // one per thread, they share table
+	vector<thread> threads;
+
+	mutex lock;                     // for everything below
+	condition_variable wake;
+	vector<unique_ptr<gamesession>> games;   // by id, nullptr once closed
+	vector<int> free_ids;
+	priority_queue<moverequest, vector<moverequest>, laterrequest> queue;
+	uint64_t sequence = 0;
+	latencyhistogram latencies;
+	bool quitting = false;
+
+	chrono::steady_clock::time_point started = chrono::steady_clock::now();
+
+	func worker_loop(board& worker) -> void {
+		loop() {
+			var request = moverequest();
+			var session = (gamesession*)nullptr;
+			{
+				var guard = unique_lock(lock);
+				wake.wait(guard, lambda() { return quitting || not queue.empty(); });
+				if (queue.empty()) return;
+				request = queue.top();
+				queue.pop();
+				session = games[request.game].get();
+			}
+
+			// a copy, once the game is not busy the callback may already request its next move
+			let move = serve(worker, *session, request.kind);
+			let position = session->position;
+			{
+				var guard = lock_guard(lock);
+				latencies.add(elapsed_ms(request.submitted));
+				session->busy = false;
+			}
+			moves++;
+			request.done(move, position);
+		}
+	}
+
+	// the move for one request, played in the session
+	func serve(board& worker, gamesession& session, requestkind kind) -> movedata {
+		static_cast<boardstate&>(worker) = session.position;
+		worker.key_history.assign(session.key_history.begin(), session.key_history.end());
+		worker.reversible_plies = min(session.reversible_plies, int(session.key_history.size()));
+		if (worker.black_won() || worker.white_won()) return NONE_MOVE;
+
+		let start = chrono::steady_clock::now();
+		var move = NONE_MOVE;
+		if (kind == RANDOM_MOVE) {
+			move = worker.find_random();
+		}
+		else {
+			var limits = searchlimits{ session.depth };
+			limits.clock = chrono::milliseconds(max(int64_t(session.clock_ms), int64_t(1)));
+			worker.stats = searchstats();
+			move = worker.find_best(limits);
+			nodes += worker.stats.nodes;
+		}
+		let ms = elapsed_ms(start);
+		session.used_ms += ms;
+		session.clock_ms = max(session.clock_ms - ms, 0.0);
+
+		worker.play_move(move);
+		session.position = worker;
+		let kept = min({ int(worker.key_history.size()), worker.reversible_plies, SESSION_HISTORY });
+		session.key_history.assign(worker.key_history.end() - kept, worker.key_history.end());
+		session.reversible_plies = worker.reversible_plies;
+		return move;
+	}
+
+public:
+	atomic<uint64_t> moves = 0;
+	atomic<uint64_t> nodes = 0;
+
+	init gameserver(int thread_count, int table_log2 = 20) : table(make_shared<transtable>(table_log2)), workers(thread_count) {
+		for (var& worker in workers) {
+			worker.transposition_table = table;
+		}
+		for (var& worker in workers) {
+			threads.emplace_back(lambda() { worker_loop(worker); });
+		}
+	}
+
+	// the queued requests are still served
+	~gameserver() {
+		{
+			var guard = lock_guard(lock);
+			quitting = true;
+		}
+		wake.notify_all();
+		for (var& thread in threads) {
+			thread.join();
+		}
+	}
+
+	// budget_ms is the search time of the whole game, depth the most any move searches
+	func open_game(string position, int depth, double budget_ms) -> int {
+		var session = make_unique<gamesession>();
+		let b = parse_to_board(position);
+		session->position = b;
+		session->depth = depth;
+		session->clock_ms = budget_ms;
+
+		var guard = lock_guard(lock);
+		if (free_ids.empty()) {
+			games.push_back(move(session));
+			return int(games.size()) - 1;
+		}
+		let id = free_ids.back();
+		free_ids.pop_back();
+		games[id] = move(session);
+		return id;
+	}
+
+	// only between requests of the game
+	func close_game(int id) -> void {
+		var guard = lock_guard(lock);
+		games[id].reset();
+		free_ids.push_back(id);
+	}
+
+	// one request per game at a time, a second one while it runs is ignored
+	func request(int id, requestkind kind, movecallback done) -> bool {
+		{
+			var guard = lock_guard(lock);
+			var& session = *games[id];
+			if (session.busy) return false;
+			session.busy = true;
+			queue.push(moverequest{ id, kind, move(done), chrono::steady_clock::now(), session.used_ms, sequence++ });
+		}
+		wake.notify_one();
+		return true;
+	}
+
+	func moves_per_second() -> double {
+		let ms = elapsed_ms(started);
+		return ms > 0 ? moves * 1000.0 / ms : 0;
+	}
+
+	// in ms, from the request to the move
+	func latency(double p) -> double {
+		var guard = lock_guard(lock);
+		return latencies.percentile(p);
+	}
+
+	// what the open games take while they wait, on average
+	func idle_bytes() -> size_t {
+		var guard = lock_guard(lock);
+		size_t bytes = 0, open = 0;
+		for (var& session in games) {
+			if (not session) continue;
+			bytes += sizeof(gamesession) + session->key_history.capacity() * sizeof(uint64_t);
+			open++;
+		}
+		return open > 0 ? bytes / open : 0;
+	}
+
+	func table_bytes() const -> size_t {
+		return table->slots.size() * sizeof(ttslot);
+	}
+};
+
+// usage: serve [games=1000] [threads=4] [depth=3] [budget=2000] [maxmoves=200]
+// plays all games at once on one server: the engine as black, with budget ms for the
+// whole game, against random moves as white
+func run_serve(vector<string> args) -> int {
+	let games = stoi(arg_or(args, 0, "1000"));
+	let threads = stoi(arg_or(args, 1, "4"));
+	let depth = stoi(arg_or(args, 2, "3"));
+	let budget = stod(arg_or(args, 3, "2000"));
+	let maxmoves = stoi(arg_or(args, 4, "200"));
+
+	var server = gameserver(threads);
+	var done_lock = mutex();
+	var all_done = condition_variable();
+	var running = games;
+	var black_wins = 0, white_wins = 0;
+	var played = vector<int>(games);
+
+	// every move asks for the next one until the game is over
+	var callback_for = function<movecallback(int)>();
+	callback_for = [&](int id) -> movecallback {
+		return [&, id](movedata move, const boardstate& position) {
+			let black_won = position.captured_white_pieces >= 6;
+			let white_won = position.captured_black_pieces >= 6;
+			if (move.is_valid() && not black_won && not white_won && ++played[id] < maxmoves) {
+				server.request(id, position.current_turn == BLACK ? BEST_MOVE : RANDOM_MOVE, callback_for(id));
+				return;
+			}
+
+			var guard = lock_guard(done_lock);
+			black_wins += black_won;
+			white_wins += white_won;
+			if (--running == 0) all_done.notify_one();
+		};
+	};
+
+	let start = chrono::steady_clock::now();
+	// a new server numbers its games from 0
+	for (var opened = 0; opened < games; opened++) {
+		let id = server.open_game(STARTING_BOARD, depth, budget);
+		server.request(id, BEST_MOVE, callback_for(id));
+	}
+	{
+		var guard = unique_lock(done_lock);
+		all_done.wait(guard, lambda() { return running == 0; });
+	}
+	let ms = elapsed_ms(start);
+
+	cout << "serve: " << games << " games on " << threads << " threads, " << server.moves << " moves in " << fixed << setprecision(0) << ms << " ms, "
+		<< server.moves_per_second() << " moves/s, " << per_second(server.nodes, ms) << " nodes/s\n";
+	cout << "latency: p50 " << setprecision(2) << server.latency(50) << " ms, p90 " << server.latency(90) << " ms, p99 " << server.latency(99)
+		<< " ms, max " << server.latency(100) << " ms\n";
+	cout << "memory: " << server.idle_bytes() << " bytes per waiting game, " << server.table_bytes() / (1 << 20) << " MB shared table\n";
+	cout << "games: black " << black_wins << ", white " << white_wins << ", " << games - black_wins - white_wins << " unfinished\n";
+
+	for (int id in range(games)) {
+		server.close_game(id);
+	}
+	return 0;
+}
+
+
+
+
+/////////////////////////
+// DISTRIBUTED ANALYSIS
+// a coordinator splits the root (or the first two plies) into jobs and hands them to
+// worker processes over tcp or a unix socket. one line per message:
+//  coordinator: job <id> <depth> <position>    position as in serialize_board
+//  worker:      result <id> <score> <nodes>    score for the side to move in the position
+//  coordinator: quit
+// a job that takes much longer than the others is also given to an idle worker, the
+// first result counts. the jobs are independent full window searches
+
+#ifdef ABALONE_SOCKETS
+
+// "unix:<path>" or "<host>:<port>". returns the socket or -1
+func open_socket(string address, bool listening) -> int {
+	if (address.starts_with("unix:")) {
+		let path = address.substr(5);
+		var socket_address = sockaddr_un();
+		socket_address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(socket_address.sun_path)) return -1;
+		copy(path.begin(), path.end(), socket_address.sun_path);
+
+		let fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listening) unlink(path.c_str());
+		let ok = listening
+			? bind(fd, (sockaddr*)&socket_address, sizeof(socket_address)) == 0 && listen(fd, 64) == 0
+			: connect(fd, (sockaddr*)&socket_address, sizeof(socket_address)) == 0;
+		if (not ok) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	let colon = address.rfind(':');
+	if (colon == string::npos) return -1;
+	let host = address.substr(0, colon);
+	let port = address.substr(colon + 1);
+
+	var hints = addrinfo();
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+	addrinfo* found = nullptr;
+	if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found) != 0) return -1;
+
+	var fd = -1;
+	for (var candidate = found; candidate && fd < 0; candidate = candidate->ai_next) {
+		fd = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+		if (fd < 0) continue;
+
+		var reuse = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		let ok = listening
+			? bind(fd, candidate->ai_addr, candidate->ai_addrlen) == 0 && listen(fd, 64) == 0
+			: connect(fd, candidate->ai_addr, candidate->ai_addrlen) == 0;
+		if (not ok) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(found);
+	return fd;
+}
+
+func send_line(int fd, string line) -> bool {
+	line += '\n';
+#ifdef MSG_NOSIGNAL
+	let flags = MSG_NOSIGNAL;
+#else
+	let flags = 0;
+#endif
+	for (size_t sent = 0; sent < line.size();) {
+		let count = send(fd, line.data() + sent, line.size() - sent, flags);
+		if (count <= 0) return false;
+		sent += count;
+	}
+	return true;
+}
+
+// one end of a connection, collects received bytes into lines
+struct linereader {
+	int fd;
+	string buffer;
+
+	// reads what is there, false once the other side is gone
+	func receive() -> bool {
+		char data[4096];
+		let count = recv(fd, data, sizeof(data), 0);
+		if (count <= 0) return false;
+		buffer.append(data, count);
+		return true;
+	}
+
+	func next_line(string& line) -> bool {
+		let end = buffer.find('\n');
+		if (end == string::npos) return false;
+		line = buffer.substr(0, end);
+		buffer.erase(0, end + 1);
+		return true;
+	}
+};
+
+
+// the score of a position for the side to move
+func score_position(board& b, int depth, int threads) -> int {
+	if (depth == 0 || b.black_won() || b.white_won()) {
+		return b.evaluate() * b.current_turn;
+	}
+	b.find_best(searchlimits{ depth, chrono::milliseconds(0), threads });
+	return b.transposition_table->probe(b.boardhash).score;
+}
+
+// usage: worker [address=unix:/tmp/abalone.sock] [threads=1]
+// connects to a coordinator, retrying for a few seconds, and searches jobs until told to quit
+func run_worker(vector<string> args) -> int {
+	let address = arg_or(args, 0, "unix:/tmp/abalone.sock");
+	let threads = stoi(arg_or(args, 1, "1"));
+
+	var fd = open_socket(address, false);
+	for (var attempts = 0; fd < 0 && attempts < 50; attempts++) {
+		this_thread::sleep_for(chrono::milliseconds(100));
+		fd = open_socket(address, false);
+	}
+	if (fd < 0) {
+		cerr << "worker: could not connect to " << address << "\n";
+		return 1;
+	}
+
+	var reader = linereader{ fd };
+	for (var line = string(); ;) {
+		while (not reader.next_line(line)) {
+			if (not reader.receive()) {
+				close(fd);
+				return 0;
+			}
+		}
+
+		var fields = stringstream(line);
+		var command = string(), position = string();
+		int id = 0, depth = 0;
+		fields >> command >> id >> depth >> position;
+		if (command is "quit") break;
+		if (command != "job") continue;
+
+		// a fresh board per job, a table that is reused would make results depend on the job order
+		var b = parse_to_board(position);
+		let score = score_position(b, depth, threads);
+		if (not send_line(fd, "result " + to_string(id) + " " + to_string(score) + " " + to_string(b.stats.nodes))) break;
+	}
+
+	close(fd);
+	return 0;
+}
+
+
+struct analysisjob {
+	string position;
+	int depth;
+	int root_move;          // the index of the root move it scores
+	bool reply;             // a position after a root move and a reply, the second ply
+	bool done = false;
+	int running = 0;        // workers that have it
+	chrono::steady_clock::time_point started;
+};
+
+struct workerslot {
+	linereader reader;
+	int job = -1;
+};
+
+// a job counts as slow once it runs this many times longer than the average finished one
+let SLOW_JOB_FACTOR = 3.0;
+
+// how long the coordinator waits for a worker once all of them are gone
+let NO_WORKERS_MS = 10000.0;
+
+// usage: distribute [address=unix:/tmp/abalone.sock] [depth=6] [local workers=2] [plies=1] [position]
+// local workers are forked from this process, more can connect with the worker tool
+func run_distribute(vector<string> args) -> int {
+	let address = arg_or(args, 0, "unix:/tmp/abalone.sock");
+	let depth = stoi(arg_or(args, 1, "6"));
+	let local_workers = stoi(arg_or(args, 2, "2"));
+	let plies = clamp(stoi(arg_or(args, 3, "1")), 1, 2);
+	var root = parse_to_board(arg_or(args, 4, STARTING_BOARD));
+
+	// the jobs, the same root moves search_root would look at
+	var root_moves = vector<movedata>();
+	var jobs = vector<analysisjob>();
+	var root_list = movelist();
+	var root_pick = movegen(&root, root_list);
+	for (var move = root_pick.next(); move.is_valid(); move = root_pick.next()) {
+		var child = root;
+		child.make_move(move);
+		let index = int(root_moves.size());
+		root_moves.push_back(move);
+
+		if (plies == 1 || depth < 2 || child.black_won() || child.white_won()) {
+			jobs.push_back(analysisjob{ serialize_board(child), depth - 1, index, false });
+			continue;
+		}
+
+		var reply_list = movelist();
+		var reply_pick = movegen(&child, reply_list);
+		for (var reply = reply_pick.next(); reply.is_valid(); reply = reply_pick.next()) {
+			var grandchild = child;
+			grandchild.make_move(reply);
+			jobs.push_back(analysisjob{ serialize_board(grandchild), depth - 2, index, true });
+		}
+	}
+
+	let listener = open_socket(address, true);
+	if (listener < 0) {
+		cerr << "distribute: could not listen on " << address << "\n";
+		return 1;
+	}
+
+	cout << "distribute: " << jobs.size() << " jobs for " << root_moves.size() << " root moves, depth " << depth << ", " << address << "\n";
+	cout.flush();
+
+	var children = vector<pid_t>();
+	while (int(children.size()) < local_workers) {
+		let pid = fork();
+		if (pid == 0) {
+			close(listener);
+			_exit(run_worker({ address }));
+		}
+		children.push_back(pid);
+	}
+
+	let start = chrono::steady_clock::now();
+	var scores = vector<int>(root_moves.size(), INFINITE_SCORE);
+	var pending = vector<int>();
+	for (int i = int(jobs.size()) - 1; i >= 0; i--) {
+		pending.push_back(i);   // handed out from the back, so in order
+	}
+
+	var workers = vector<workerslot>();
+	var finished = 0, redispatched = 0, duplicates = 0, most_workers = 0;
+	uint64_t nodes = 0;
+	var finished_ms = 0.0;
+	var alone_since = chrono::steady_clock::now();   // since when there is no worker
+
+	func dispatch = lambda(workerslot& worker) {
+		var job = -1;
+		if (not pending.empty()) {
+			job = pending.back();
+			pending.pop_back();
+		}
+		else if (finished > 0) {
+			// nothing new, so help with the job that has been running the longest, if it is slow
+			let slow_ms = SLOW_JOB_FACTOR * finished_ms / finished;
+			for (int i in range(int(jobs.size()))) {
+				if (jobs[i].done || jobs[i].running != 1 || elapsed_ms(jobs[i].started) < slow_ms) continue;
+				if (job < 0 || jobs[i].started < jobs[job].started) job = i;
+			}
+			if (job >= 0) redispatched++;
+		}
+		if (job < 0) return;
+
+		if (jobs[job].running == 0) jobs[job].started = chrono::steady_clock::now();
+		jobs[job].running++;
+		worker.job = job;
+		send_line(worker.reader.fd, "job " + to_string(job) + " " + to_string(jobs[job].depth) + " " + jobs[job].position);
+	};
+
+	// a reply job is scored for the root side, a root move job for the opponent
+	func record = lambda(analysisjob& job, int score) {
+		job.done = true;
+		finished++;
+		finished_ms += elapsed_ms(job.started);
+		var& root_score = scores[job.root_move];
+		root_score = job.reply ? min(root_score, score) : -score;
+	};
+
+	func lost = lambda(workerslot& worker) {
+		if (worker.job >= 0) {
+			var& job = jobs[worker.job];
+			job.running--;
+			if (not job.done && job.running == 0) pending.push_back(worker.job);
+		}
+		close(worker.reader.fd);
+	};
+
+	while (finished < int(jobs.size())) {
+		var polled = vector<pollfd>{ pollfd{ listener, POLLIN, 0 } };
+		for (var& worker in workers) {
+			polled.push_back(pollfd{ worker.reader.fd, POLLIN, 0 });
+		}
+
+		// wake up now and then to look for slow jobs
+		if (poll(polled.data(), polled.size(), 100) < 0) break;
+
+		if (polled[0].revents & POLLIN) {
+			let fd = accept(listener, nullptr, nullptr);
+			if (fd >= 0) {
+				workers.push_back(workerslot{ linereader{ fd } });
+				most_workers = max(most_workers, int(workers.size()));
+			}
+		}
+
+		for (int i in range(1, int(polled.size()))) {
+			var& worker = workers[i - 1];
+			if (not (polled[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+			if (not worker.reader.receive()) {
+				lost(worker);
+				worker.reader.fd = -1;
+				continue;
+			}
+
+			for (var line = string(); worker.reader.next_line(line);) {
+				var fields = stringstream(line);
+				var command = string();
+				int id = -1, score = 0;
+				uint64_t job_nodes = 0;
+				fields >> command >> id >> score >> job_nodes;
+				if (command != "result" || id < 0 || id >= int(jobs.size())) continue;
+
+				var& job = jobs[id];
+				job.running--;
+				worker.job = -1;
+				nodes += job_nodes;
+				if (job.done) {
+					duplicates++;
+					continue;
+				}
+				record(job, score);
+			}
+		}
+
+		erase_if(workers, lambda(const workerslot& worker) { return worker.reader.fd < 0; });
+		for (var& worker in workers) {
+			if (worker.job < 0) dispatch(worker);
+		}
+
+		// local workers that exited are not coming back. with no worker left at all, the jobs
+		// go back to pending. give another one some time to connect, then search them here
+		erase_if(children, lambda(pid_t pid) { return waitpid(pid, nullptr, WNOHANG) == pid; });
+		if (not workers.empty() || not children.empty()) {
+			alone_since = chrono::steady_clock::now();
+		}
+		else if (elapsed_ms(alone_since) > NO_WORKERS_MS) {
+			cerr << "distribute: no workers left, searching the last " << pending.size() << " jobs here\n";
+			for (var id in pending) {
+				var& job = jobs[id];
+				var b = parse_to_board(job.position);
+				job.started = chrono::steady_clock::now();
+				record(job, score_position(b, job.depth, 1));
+				nodes += b.stats.nodes;
+			}
+			pending.clear();
+		}
+	}
+
+	for (var& worker in workers) {
+		send_line(worker.reader.fd, "quit");
+		close(worker.reader.fd);
+	}
+	close(listener);
+	if (address.starts_with("unix:")) unlink(address.substr(5).c_str());
+	for (var pid in children) {
+		waitpid(pid, nullptr, 0);
+	}
+
+	let ms = elapsed_ms(start);
+	if (finished < int(jobs.size())) {
+		cerr << "distribute: stopped with " << jobs.size() - finished << " jobs left\n";
+		return 1;
+	}
+
+	var order = vector<int>(root_moves.size());
+	iota(order.begin(), order.end(), 0);
+	stable_sort(order.begin(), order.end(), lambda(int a, int b) { return scores[a] > scores[b]; });
+	for (var i in order) {
+		var text = serilize_move(root_moves[i]);
+		text.pop_back();
+		cout << setw(12) << text << " " << setw(8) << scores[i] << "\n";
+	}
+
+	var best = serilize_move(root_moves[order.front()]);
+	best.pop_back();
+	cout << "distribute: best " << best << " " << scores[order.front()] << ", " << nodes << " nodes, " << fixed << setprecision(1) << ms << " ms, "
+		<< most_workers << " workers, " << redispatched << " redispatched, " << duplicates << " duplicate results\n";
+	return 0;
+}
+
+#else
+
+func run_worker(vector<string>) -> int {
+	cerr << "the worker needs posix sockets\n";
+	return 1;
+}
+
+func run_distribute(vector<string>) -> int {
+	cerr << "distribute needs posix sockets\n";
+	return 1;
+}
+
+#endif
+
+
+
+
+// the demo game, black engine against a random white player
+func run_demo() -> int {
+
+	var board = parse_to_board(STARTING_BOARD);
+	var ponder = ponderer();
+	let limits = searchlimits{ 5 };
+
+	for (int turn = 0; turn < 100; turn++) {
+
+		// Black players turn. My AI
+		var move = ponder.finish(board, limits);
+		print("After Blacks turn: \n ");
+		board.play_move(move);
+		board.print_board();
+		print(""); print("");
+
+		if (board.black_won()) {
+			print("Black Wins");
+			return 0;
+		}
+		if (board.count_repetitions() >= 2) break;
+
+		// think about the reply while white is thinking
+		ponder.start(board, limits);
+		this_thread::sleep_for(chrono::seconds(3));
 
-		this_thread::sleep_for(chrono::seconds(3));
-
 
 
 		// White players turn. Random player
 		var random = board.find_random();
-		board.make_move(random);
+		board.play_move(random);
 		print("After Whites turn: \n ");
 		board.print_board();
 		print(""); print("");
@@ -1084,6 +4741,7 @@ func main() -> int {
 			print("White Wins");
 			return 0;
 		}
+		if (board.count_repetitions() >= 2) break;
 
 		this_thread::sleep_for(chrono::seconds(3));
 
@@ -1095,6 +4753,54 @@ func main() -> int {
 
 
 
+func main(int argc, char** argv) -> int {
+	var args = vector<string>(argv + 1, argv + argc);
+
+	// --network=<file> loads a network and makes it the default evaluation, for every tool.
+	// --probcut=<file> loads the fits of the calibrate tool, the tools that prune turn it on
+	for (var arg = args.begin(); arg != args.end();) {
+		if (arg->starts_with("--network=")) {
+			if (not load_network(arg->substr(string("--network=").size()))) return 1;
+			arg = args.erase(arg);
+		}
+		else if (arg->starts_with("--probcut=")) {
+			if (not load_probcut(arg->substr(string("--probcut=").size()))) return 1;
+			arg = args.erase(arg);
+		}
+		else {
+			arg++;
+		}
+	}
+
+	// abalone_perft.exe -> perft, abalone_bench_copymake -> bench
+	var tool = string(argv[0]);
+	tool = tool.substr(tool.find_last_of("/\\") + 1);
+	tool = tool.substr(0, tool.find('.'));
+	tool = tool.substr(tool.find('_') + 1);
+	tool = tool.substr(0, tool.find('_'));
+
+	let tools = array<string, 10>{ "perft", "bench", "match", "analyze", "nnue", "solve", "serve", "worker", "distribute", "calibrate" };
+	if (find(tools.begin(), tools.end(), tool) == tools.end() && args.size() > 0) {
+		tool = args[0];
+		args.erase(args.begin());
+	}
+
+	if (tool is "perft") return run_perft(args);
+	if (tool is "bench") return run_bench(args);
+	if (tool is "match") return run_match(args);
+	if (tool is "analyze") return run_analyze(args);
+	if (tool is "nnue") return run_nnue(args);
+	if (tool is "solve") return run_solve(args);
+	if (tool is "serve") return run_serve(args);
+	if (tool is "worker") return run_worker(args);
+	if (tool is "distribute") return run_distribute(args);
+	if (tool is "calibrate") return run_calibrate(args);
+
+	return run_demo();
+}
+
+
+
 
 
 
@@ -0,0 +1,12 @@
+# clang writes one raw profile per process, -fprofile-use wants a single merged file
+file(GLOB raw_profiles "${PROFILE_DIR}/*.profraw")
+if(NOT raw_profiles)
+	message(FATAL_ERROR "no .profraw files in ${PROFILE_DIR}, did the training run use the instrumented build?")
+endif()
+
+execute_process(
+	COMMAND ${LLVM_PROFDATA} merge -output=${PROFILE_DIR}/default.profdata ${raw_profiles}
+	RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "llvm-profdata merge failed")
+endif()